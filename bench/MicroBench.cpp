@@ -0,0 +1,337 @@
+#include "SquareMatrix.h"
+#include "Operation.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "EvalPlan.h"
+#include "MatrixFormatter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <span>
+#include <spanstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Microbenchmarks of SquareMatrix, of operation trees and of the text
+// format of matrices. Prints JSON with a record per benchmark and matrix
+// size: the time, the bytes allocated and the allocations per
+// operation, so that runs before and after a change can be compared.
+//
+// Usage: oop2_ex03_microbench [--sizes n,n,...] [--min-ms t] [--depth d]
+//                             [--width w] [--sharing s] [--filter text]
+//  --sizes    matrix sizes to sweep (default 4,16,64,256,1024)
+//  --min-ms   least time measured per benchmark (default 200)
+//  --depth    layers of add/sub stacked on the base of a tree (default 8)
+//  --width    leaves of the base of a tree and of every layer (default 4)
+//  --sharing  percentage of layers whose second operand is the layer below
+//             itself - a DAG node shared by both operands (default 25)
+//  --filter   run only the benchmarks whose name contains text
+
+namespace
+{
+    std::atomic<std::size_t> g_allocations = 0;
+    std::atomic<std::size_t> g_allocatedBytes = 0;
+
+    void* countedNew(std::size_t bytes, std::size_t alignment)
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        // aligned_alloc wants a multiple of the alignment
+        const std::size_t size = (std::max<std::size_t>(bytes, 1) + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+        // The CRT has no aligned_alloc, and what _aligned_malloc returns
+        // must go to _aligned_free - so every block comes from it
+        void* ptr = _aligned_malloc(size, alignment);
+#else
+        void* ptr = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                           : std::aligned_alloc(alignment, size);
+#endif
+        if (!ptr)
+            throw std::bad_alloc();
+        return ptr;
+    }
+
+    void countedDelete(void* ptr) noexcept
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+}
+
+// Every allocation of the process is counted
+void* operator new(std::size_t bytes) { return countedNew(bytes, alignof(std::max_align_t)); }
+void* operator new[](std::size_t bytes) { return countedNew(bytes, alignof(std::max_align_t)); }
+void* operator new(std::size_t bytes, std::align_val_t alignment)
+{
+    return countedNew(bytes, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t bytes, std::align_val_t alignment)
+{
+    return countedNew(bytes, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* ptr) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr) noexcept { countedDelete(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { countedDelete(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { countedDelete(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { countedDelete(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { countedDelete(ptr); }
+
+namespace
+{
+    using Matrix = SquareMatrix<int>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Settings
+    {
+        std::vector<std::size_t> sizes{ 4, 16, 64, 256, 1024 };
+        double minMs = 200;
+        int depth = 8;
+        int width = 4;
+        int sharing = 25;
+        std::string filter;
+    };
+
+    struct Result
+    {
+        std::string name;
+        std::size_t size = 0;
+        std::size_t iterations = 0;
+        double nsPerOp = 0;
+        double bytesPerOp = 0;
+        double allocationsPerOp = 0;
+    };
+
+    // Discards what is written to it, so formatting is measured alone
+    class NullBuffer : public std::streambuf
+    {
+    protected:
+        int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, std::streamsize count) override { return count; }
+    };
+
+    Settings parseSettings(int argc, char* argv[])
+    {
+        Settings settings;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string_view option = argv[i];
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for " + std::string(option) + ".");
+            const std::string value = argv[++i];
+
+            if (option == "--sizes")
+            {
+                settings.sizes.clear();
+                for (std::size_t begin = 0; begin <= value.size();)
+                {
+                    const std::size_t end = std::min(value.find(',', begin), value.size());
+                    settings.sizes.push_back(std::stoull(value.substr(begin, end - begin)));
+                    begin = end + 1;
+                }
+            }
+            else if (option == "--min-ms")  settings.minMs = std::stod(value);
+            else if (option == "--depth")   settings.depth = std::stoi(value);
+            else if (option == "--width")   settings.width = std::max(1, std::stoi(value));
+            else if (option == "--sharing") settings.sharing = std::stoi(value);
+            else if (option == "--filter")  settings.filter = value;
+            else throw std::invalid_argument("Unknown option: " + std::string(option));
+        }
+        return settings;
+    }
+
+    // Runs body() in batches that double until at least minMs have been
+    // measured; the first call is a warm-up and is not counted
+    Result measure(std::string name, std::size_t size, double minMs, const std::function<void()>& body)
+    {
+        body();
+
+        Result result{ std::move(name), size };
+        double totalNs = 0;
+        std::size_t allocations = 0, bytes = 0;
+        for (std::size_t batch = 1; totalNs < minMs * 1e6; batch *= 2)
+        {
+            const std::size_t allocationsBefore = g_allocations.load();
+            const std::size_t bytesBefore = g_allocatedBytes.load();
+            const auto start = Clock::now();
+            for (std::size_t i = 0; i < batch; ++i)
+                body();
+            totalNs += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            allocations += g_allocations.load() - allocationsBefore;
+            bytes += g_allocatedBytes.load() - bytesBefore;
+            result.iterations += batch;
+        }
+
+        const auto iterations = static_cast<double>(result.iterations);
+        result.nsPerOp = totalNs / iterations;
+        result.bytesPerOp = static_cast<double>(bytes) / iterations;
+        result.allocationsPerOp = static_cast<double>(allocations) / iterations;
+        return result;
+    }
+
+    // Values in {-1, 0, 1}: the matrix benchmarks stay in the allowed range,
+    // but a deep enough tree can leave it (see main)
+    Matrix makeMatrix(std::size_t size, std::size_t seed)
+    {
+        Matrix matrix(size, Matrix::Uninitialized{});
+        for (std::size_t i = 0; i < size; ++i)
+            for (std::size_t j = 0; j < size; ++j)
+                matrix(i, j) = static_cast<int>((i * 7 + j * 3 + seed) % 3) - 1;
+        return matrix;
+    }
+
+    // The sum (and differences) of 'width' unary leaves
+    std::shared_ptr<Operation> makeBase(int width, int& leaf)
+    {
+        std::shared_ptr<Operation> base;
+        for (int i = 0; i < width; ++i, ++leaf)
+        {
+            std::shared_ptr<Operation> next;
+            switch (leaf % 3)
+            {
+                case 0:  next = std::make_shared<Identity>();  break;
+                case 1:  next = std::make_shared<Transpose>(); break;
+                default: next = std::make_shared<Scalar>(-1);  break;
+            }
+            if (!base)
+                base = next;
+            else if (i % 2 == 0)
+                base = std::make_shared<Add>(base, next);
+            else
+                base = std::make_shared<Sub>(base, next);
+        }
+        return base;
+    }
+
+    // A base of 'width' leaves with 'depth' layers on it. A layer adds to
+    // (or subtracts from) the layer below either a new base or - for
+    // 'sharing' percent of the layers - the layer below itself.
+    std::shared_ptr<Operation> makeTree(const Settings& settings)
+    {
+        int leaf = 0;
+        auto tree = makeBase(settings.width, leaf);
+        for (int layer = 0; layer < settings.depth; ++layer)
+        {
+            const bool shared = (layer * settings.sharing) % 100 + settings.sharing >= 100;
+            const auto operand = shared ? tree : makeBase(settings.width, leaf);
+            if (layer % 2 == 0)
+                tree = std::make_shared<Add>(tree, operand);
+            else
+                tree = std::make_shared<Sub>(tree, operand);
+        }
+        return tree;
+    }
+
+    void printJson(const std::vector<Result>& results, const Settings& settings)
+    {
+        std::printf("{\n  \"tree\": { \"depth\": %d, \"width\": %d, \"sharing\": %d },\n"
+                    "  \"results\": [\n", settings.depth, settings.width, settings.sharing);
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& result = results[i];
+            std::printf("    { \"name\": \"%s\", \"size\": %zu, \"iterations\": %zu, "
+                        "\"ns_per_op\": %.1f, \"bytes_per_op\": %.1f, \"allocations_per_op\": %.2f }%s\n",
+                        result.name.c_str(), result.size, result.iterations, result.nsPerOp,
+                        result.bytesPerOp, result.allocationsPerOp,
+                        i + 1 < results.size() ? "," : "");
+        }
+        std::printf("  ]\n}\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    try
+    {
+        settings = parseSettings(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    const auto tree = makeTree(settings);
+    const auto inputCount = static_cast<std::size_t>(tree->inputCount());
+    std::vector<Result> results;
+    volatile int sink = 0;
+
+    for (const std::size_t size : settings.sizes)
+    {
+        const Matrix a = makeMatrix(size, 0), b = makeMatrix(size, 1);
+        std::vector<Matrix> inputs;
+        for (std::size_t i = 0; i < inputCount; ++i)
+            inputs.push_back(makeMatrix(size, i));
+        const EvalPlan plan(*tree, size);
+        EvalPlan::Workspace workspace;
+
+        // The text of 'a' as eval reads it, and a stream to parse it from
+        MatrixFormatter text;
+        text.append(a.view());
+        const std::string source(text.text());
+        Matrix parsed(size, Matrix::Uninitialized{});
+        NullBuffer nullBuffer;
+        std::ostream null(&nullBuffer);
+
+        const std::vector<std::pair<std::string, std::function<void()>>> benchmarks
+        {
+            { "matrix/construct_value",   [&] { sink = Matrix(size, 1)(0, 0); } },
+            { "matrix/construct_uninit",  [&] { sink = Matrix(size, Matrix::Uninitialized{}).data()[0]; } },
+            { "matrix/copy",              [&] { sink = Matrix(a)(0, 0); } },
+            { "matrix/add",               [&] { sink = (a + b)(0, 0); } },
+            { "matrix/sub",               [&] { sink = (a - b)(0, 0); } },
+            { "matrix/scale",             [&] { sink = (a * 3)(0, 0); } },
+            { "matrix/transpose",         [&] { sink = a.Transpose()(0, 0); } },
+            { "tree/compute",             [&] { sink = tree->compute(std::span<const Matrix>(inputs))(0, 0); } },
+            { "tree/plan",                [&] { sink = plan.run(inputs, workspace)(0, 0); } },
+            { "text/parse",               [&]
+                {
+                    std::ispanstream input(source);
+                    input >> parsed;
+                    sink = parsed(0, 0);
+                } },
+            { "text/format",              [&] { text.append(a.view()).flush(null); } },
+        };
+
+        for (const auto& [name, body] : benchmarks)
+        {
+            if (name.find(settings.filter) == std::string::npos)
+                continue;
+            // A tree whose result leaves the allowed range is reported and
+            // skipped - the other benchmarks still run
+            try
+            {
+                results.push_back(measure(name, size, settings.minMs, body));
+            }
+            catch (const std::out_of_range& e)
+            {
+                std::fprintf(stderr, "%-24s %6zu skipped: %s\n", name.c_str(), size, e.what());
+                continue;
+            }
+            std::fprintf(stderr, "%-24s %6zu %14.1f ns/op\n", name.c_str(), size, results.back().nsPerOp);
+        }
+    }
+
+    printJson(results, settings);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "SquareMatrix.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+// Compares the previous Transpose (fill the result with 0..n*n-1, then a
+// column-strided copy) with the cache-oblivious and the in-place kernels.
+
+namespace
+{
+    using Matrix = SquareMatrix<int>;
+    using Clock = std::chrono::steady_clock;
+
+    // Powers of two and their neighbours, where strided access is worst
+    const std::size_t SIZES[] = { 64, 256, 512, 1000, 1024, 2048, 2049, 4096 };
+
+    // Best time of one call in milliseconds, repeated for at least ~200ms
+    double bestMs(const std::function<void()>& body)
+    {
+        double best = 1e300, total = 0;
+        for (int run = 0; run < 3 || total < 200.0; ++run)
+        {
+            const auto start = Clock::now();
+            body();
+            const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            best = std::min(best, ms);
+            total += ms;
+        }
+        return best;
+    }
+
+    Matrix naiveTranspose(const Matrix& matrix)
+    {
+        Matrix result(matrix.size());
+        for (std::size_t i = 0; i < matrix.size(); ++i)
+        {
+            for (std::size_t j = 0; j < matrix.size(); ++j)
+            {
+                result(i, j) = matrix(j, i);
+            }
+        }
+        return result;
+    }
+}
+
+int main()
+{
+    std::printf("%8s %12s %12s %12s %10s %10s\n",
+                "size", "naive ms", "blocked ms", "inplace ms", "blocked x", "inplace x");
+
+    for (const std::size_t size : SIZES)
+    {
+        Matrix matrix(size);
+        int sink = 0;
+
+        const double naive = bestMs([&] { sink += naiveTranspose(matrix)(0, 1); });
+        const double blocked = bestMs([&] { sink += matrix.Transpose()(0, 1); });
+        const double inPlace = bestMs([&] { matrix.transposeInPlace(); sink += matrix(0, 1); });
+
+        std::printf("%8zu %12.3f %12.3f %12.3f %10.2f %10.2f%s\n", size, naive, blocked, inPlace,
+                    naive / blocked, naive / inPlace, sink == 42 ? " " : "");
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include "MemoryStats.h"
+
+// Alignment (in bytes) of every matrix buffer - one cache line
+const std::size_t MATRIX_ALIGNMENT = 64;
+
+// Minimal allocator that returns memory aligned to Alignment bytes,
+// used so that the rows of a matrix start on a cache line boundary.
+// The memory comes from a std::pmr::memory_resource (the default resource
+// unless one is given), and like std::pmr::polymorphic_allocator the
+// resource stays with the container: it is not propagated on assignment,
+// and a copy of a container goes back to the default resource.
+// Elements constructed without arguments are default-initialized (not zeroed),
+// so a buffer that is about to be overwritten is not filled twice.
+template <typename T, std::size_t Alignment>
+class AlignedAllocator
+{
+public:
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+	AlignedAllocator(std::pmr::memory_resource* resource) : m_resource(resource) {}
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>& other) : m_resource(other.resource()) {}
+	// So that std::pmr containers pass their resource on to their matrices
+	template <typename U>
+	AlignedAllocator(const std::pmr::polymorphic_allocator<U>& other) : m_resource(other.resource()) {}
+
+	T* allocate(std::size_t count);
+	void deallocate(T* ptr, std::size_t count);
+
+	template <typename U, typename... Args>
+	void construct(U* ptr, Args&&... args);
+
+	AlignedAllocator select_on_container_copy_construction() const { return AlignedAllocator(); }
+	std::pmr::memory_resource* resource() const { return m_resource; }
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>& other) const
+	{
+		return m_resource == other.resource() || m_resource->is_equal(*other.resource());
+	}
+
+private:
+	std::pmr::memory_resource* m_resource = std::pmr::get_default_resource();
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t Alignment>
+T* AlignedAllocator<T, Alignment>::allocate(std::size_t count)
+{
+	MemoryStats::allocated(MemoryKind::Matrix, count * sizeof(T));
+	return static_cast<T*>(m_resource->allocate(count * sizeof(T), Alignment));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t Alignment>
+void AlignedAllocator<T, Alignment>::deallocate(T* ptr, std::size_t count)
+{
+	MemoryStats::deallocated(MemoryKind::Matrix, count * sizeof(T));
+	m_resource->deallocate(ptr, count * sizeof(T), Alignment);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t Alignment>
+template <typename U, typename... Args>
+void AlignedAllocator<T, Alignment>::construct(U* ptr, Args&&... args)
+{
+	if constexpr (sizeof...(Args) == 0)
+	{
+		::new (static_cast<void*>(ptr)) U;
+	}
+	else
+	{
+		::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+	}
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "MatrixFile.h"
+#include "MatrixFormatter.h"
+#include "ThreadPool.h"
+
+// Elements of input matrices read ahead and evaluated together
+const std::size_t BATCH_CHUNK_ELEMENTS = std::size_t{ 1 } << 22;
+
+// Totals of one evalbatch run
+struct BatchReport
+{
+	std::size_t sets = 0;
+	std::size_t outOfRange = 0; // sets whose result left the allowed range
+	double seconds = 0;
+};
+
+// Reads up to sets.size() / inputCount input sets into 'sets' (set i is
+// sets[i * inputCount, (i + 1) * inputCount)); returns how many were read.
+// 'before' is the number of sets read by earlier calls.
+// A set that is malformed or cut short ends the reading: 'badSet' gets the
+// std::runtime_error for it, and the sets before it are returned.
+template <typename Matrix>
+std::size_t readBatchSets(std::istream& input, std::vector<Matrix>& sets, std::size_t inputCount,
+                          std::size_t before, std::exception_ptr& badSet)
+{
+	const std::size_t capacity = sets.size() / inputCount;
+	for (std::size_t i = 0; i < capacity; ++i)
+	{
+		if ((input >> std::ws).eof())
+			return i;
+
+		try
+		{
+			for (std::size_t j = 0; j < inputCount; ++j)
+				input >> sets[i * inputCount + j];
+		}
+		catch (const std::exception& e)
+		{
+			const std::string where = "input set #" + std::to_string(before + i + 1);
+			badSet = std::make_exception_ptr(std::runtime_error(
+				input ? "Invalid " + where + ": " + e.what()
+				      : "The file ends in the middle of " + where + "."));
+			return i;
+		}
+	}
+	return capacity;
+}
+
+//-----------------------------------------------------------------------------
+
+// Streams input sets through one operation. A set is 'inputCount' matrices
+// like 'blank', read from 'input' like eval reads them, and its result - or
+// the range error it ran into - is written to 'output' in input order.
+// The sets are read a chunk at a time and a chunk is split into contiguous
+// shards that are evaluated in parallel. Every shard has an evaluator of its
+// own, so its scratch buffers are reused from set to set, and renders its
+// results into a formatter of its own; the texts are written out in order,
+// one write each, and the formatters keep their buffers for the next chunk.
+// makeEvaluator() returns a function object that takes a
+// std::span<const Matrix> set and returns its result.
+// A malformed set stops the run with a std::runtime_error, after the results
+// of every set before it are written.
+template <typename Matrix, typename MakeEvaluator>
+BatchReport runBatch(std::istream& input, std::ostream& output, const Matrix& blank,
+                     std::size_t inputCount, MakeEvaluator makeEvaluator)
+{
+	BatchReport report;
+	const auto start = std::chrono::steady_clock::now();
+	ThreadPool& pool = ThreadPool::instance();
+
+	const std::size_t setElements = std::max<std::size_t>(1, blank.size() * blank.size() * inputCount);
+	const std::size_t chunk = std::max(BATCH_CHUNK_ELEMENTS / setElements, pool.threadCount());
+	std::vector<Matrix> sets(chunk * inputCount, blank);
+	std::vector<decltype(makeEvaluator())> evaluators;
+	std::vector<MatrixFormatter> texts;
+
+	std::exception_ptr badSet;
+	while (!badSet)
+	{
+		const std::size_t count = readBatchSets(input, sets, inputCount, report.sets, badSet);
+		if (count == 0)
+			break;
+
+		const std::size_t tasks = std::min(count, pool.taskCount(count * setElements));
+		while (evaluators.size() < tasks)
+			evaluators.push_back(makeEvaluator());
+		texts.resize(std::max(texts.size(), tasks));
+		std::vector<std::size_t> outOfRange(tasks);
+
+		pool.parallelFor(tasks, [&](std::size_t task)
+		{
+			auto& evaluate = evaluators[task];
+			for (std::size_t i = count * task / tasks; i < count * (task + 1) / tasks; ++i)
+			{
+				try
+				{
+					const auto& result = evaluate(std::span<const Matrix>(sets.data() + i * inputCount,
+					                                                      inputCount));
+					texts[task].append(result.view()).append("\n");
+				}
+				catch (const std::out_of_range& e)
+				{
+					++outOfRange[task];
+					texts[task].append(e.what()).append("\n\n");
+				}
+			}
+		});
+
+		for (std::size_t task = 0; task < tasks; ++task)
+		{
+			texts[task].flush(output);
+			report.outOfRange += outOfRange[task];
+		}
+		report.sets += count;
+	}
+
+	if (!output)
+		throw std::runtime_error("Failed to write the results.");
+	if (badSet)
+		std::rethrow_exception(badSet);
+
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return report;
+}
+
+//-----------------------------------------------------------------------------
+
+// runBatch() for the input sets of a matrix file: set i is matrices
+// [i * inputCount, (i + 1) * inputCount) of 'input', and its result is
+// matrix i of 'output' - or, when it ran into a range error, marked out of
+// range there. The sets are copied straight out of the mapping, without any
+// parsing, and every shard stores its results in their own slots of the
+// output mapping, so nothing is formatted or put back in order.
+// Throws std::runtime_error for an input value out of the allowed range,
+// like the text form does.
+template <typename Matrix, typename MakeEvaluator>
+BatchReport runBatch(const MatrixFile& input, MatrixFile& output, const Matrix& blank,
+                     std::size_t inputCount, MakeEvaluator makeEvaluator)
+{
+	BatchReport report;
+	const auto start = std::chrono::steady_clock::now();
+	ThreadPool& pool = ThreadPool::instance();
+
+	const std::size_t count = output.count();
+	const std::size_t setElements = std::max<std::size_t>(1, blank.size() * blank.size() * inputCount);
+	const std::size_t tasks = std::min(count, pool.taskCount(count * setElements));
+	std::vector<std::size_t> outOfRange(tasks);
+
+	pool.parallelFor(tasks, [&](std::size_t task)
+	{
+		auto evaluate = makeEvaluator();
+		std::vector<Matrix> set(inputCount, blank);
+		for (std::size_t i = count * task / tasks; i < count * (task + 1) / tasks; ++i)
+		{
+			try
+			{
+				for (std::size_t j = 0; j < inputCount; ++j)
+				{
+					loadMatrix(input.matrix(i * inputCount + j), set[j]);
+					set[j].checkValidRange();
+				}
+			}
+			catch (const std::out_of_range& e)
+			{
+				throw std::runtime_error("Invalid input set #" + std::to_string(i + 1) + ": " + e.what());
+			}
+
+			try
+			{
+				storeMatrix(evaluate(std::span<const Matrix>(set)), output.matrix(i));
+			}
+			catch (const std::out_of_range&)
+			{
+				++outOfRange[task];
+				output.setOutOfRange(i);
+			}
+		}
+	});
+
+	report.sets = count;
+	for (const std::size_t sets : outOfRange)
+		report.outOfRange += sets;
+	report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return report;
+}
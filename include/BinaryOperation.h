@@ -1,20 +1,47 @@
 #pragma once
 #include "Operation.h"
+#include "FusedExpression.h"
 #include <memory>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <utility>
 
 class BinaryOperation : public Operation
 {
 public:
     BinaryOperation(const std::shared_ptr<Operation>& arg1, const std::shared_ptr<Operation>& arg2);
-	int inputCount() const override { return m_first->inputCount() + m_second->inputCount(); }
-
-protected:
+	int inputCount() const final { return m_inputCount; }
     const std::shared_ptr<Operation>& first() const { return m_first; }
     const std::shared_ptr<Operation>& second() const { return m_second; }
+
+    // Index of the first input of second() - the inputs before it belong to first()
+    std::size_t secondOffset() const { return m_secondOffset; }
+
+protected:
+    // sharedInputs inputs of second() are not inputs of this operation
+    BinaryOperation(const std::shared_ptr<Operation>& arg1, const std::shared_ptr<Operation>& arg2,
+                    int sharedInputs);
+
+    // The results of first() and second(); on large matrices the two are
+    // computed in parallel
+    std::pair<T, T> computeOperands(Inputs input) const;
+
+    // The fused program of this operation, compiled by the first call (from
+    // any thread), or nullptr when the operation is not fusable at its root
+    const FusedExpression* fused() const;
+
     virtual void printSymbol(std::ostream& ostr) const = 0;
     void print(std::ostream& ostr, bool first_print =false) const override;
 
 private:
     const std::shared_ptr<Operation> m_first;
     const std::shared_ptr<Operation> m_second;
+
+    // Computed once, the children cannot change
+    const int m_inputCount;
+    const std::size_t m_secondOffset;
+
+    mutable std::once_flag m_fuseOnce;
+    mutable std::optional<FusedExpression> m_fused;
 };
\ No newline at end of file
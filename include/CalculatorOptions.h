@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include "Utility.h"
+#include "ElementTypes.h"
+
+// Largest matrix size accepted by eval unless configured otherwise
+const std::size_t DEFAULT_MAX_MAT_SIZE = 5;
+// Largest matrix size in large-matrix mode (--large)
+const std::size_t LARGE_MAX_MAT_SIZE = 16384;
+// Upper bound for --max-size
+const std::size_t MAX_CONFIGURABLE_MAT_SIZE = 65536;
+// Bounds of the limit on the number of operations
+const int MIN_OPERATION_LIMIT = 2;
+const int MAX_OPERATION_LIMIT = 100;
+
+// An allowed range given with --range for the element type T
+template <typename T>
+using AllowedRange = std::optional<std::pair<T, T>>;
+
+template <typename List>
+struct AllowedRangesOf;
+
+template <typename... T>
+struct AllowedRangesOf<std::tuple<T...>>
+{
+    using type = std::tuple<AllowedRange<T>...>;
+};
+
+// One AllowedRange per C++ type of ElementTypeList
+using AllowedRanges = AllowedRangesOf<ElementTypeList>::type;
+
+// Settings of the calculator given on the command line
+struct CalculatorOptions
+{
+    std::size_t maxMatSize = DEFAULT_MAX_MAT_SIZE;
+    RangePolicy rangePolicy = RangePolicy::Checked;
+    // The types without one keep defaultAllowedRange
+    AllowedRanges allowedRanges;
+    // The element type eval computes in unless it is given --type
+    ElementType elementType = ElementType::Int;
+    // New operations are rewritten into cheaper equivalent ones (see Simplifier)
+    bool simplify = true;
+    // eval prints the input matrices back with the result
+    bool echoInputs = true;
+    // Anything but Ask runs scripts unattended (see Read)
+    ScriptPolicy scriptPolicy = ScriptPolicy::Ask;
+    // Threads evaluating large matrices (0 = one per hardware thread)
+    std::size_t threads = 1;
+    // The limit on the number of operations (0 = asked for at the start)
+    int maxOperations = 0;
+    // Serve sessions on this Unix domain socket instead of the console
+    std::string servePath;
+
+    // Throws std::invalid_argument for unknown or malformed options
+    static CalculatorOptions parse(int argc, const char* const argv[]);
+    static std::string usage();
+};
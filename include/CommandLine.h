@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A command line split into whitespace-separated tokens in a single pass.
+// The tokens are views of the line the object keeps, and its buffers are
+// reused from line to line, so a command is read without any stream or
+// allocation of its own. Tokens are taken in order with next().
+class CommandLine
+{
+public:
+    void assign(std::string_view line);
+    // Reads the next line of 'istr' like std::getline; returns whether it
+    // is not empty
+    bool readLine(std::istream& istr);
+
+    // The number of tokens in the whole line
+    std::size_t size() const { return m_tokens.size(); }
+    // The next token not taken yet; empty when none is left
+    std::string_view next();
+    // The rest of the line from the second character after the first token
+    // on, spaces and all
+    std::string_view afterFirst() const;
+
+private:
+    void split();
+
+    std::string m_line;
+    std::vector<std::string_view> m_tokens;
+    std::size_t m_next = 0;
+};
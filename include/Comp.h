@@ -7,8 +7,9 @@
 class Comp : public BinaryOperation
 {
 public:
-    using BinaryOperation::BinaryOperation;
-    int inputCount() const override;
-    T compute(const std::vector<T>& input) const override;
+    // The first input of 'second' is the result of 'first'
+    Comp(const std::shared_ptr<Operation>& first, const std::shared_ptr<Operation>& second);
+    T compute(Inputs input) const override;
+    void accept(OperationVisitor& visitor) const override;
     void printSymbol(std::ostream& ostr) const override;
 };
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include "Utility.h"
+
+// Elements computed between two range checks of the element-wise kernels
+const std::size_t ELEMENT_TILE = 256;
+
+// Element-wise kernels for the element types other than int, which has the
+// SIMD kernels of MatrixKernels. They keep the same contract: a whole tile
+// is computed first, with a min/max reduction and no branch in the loop,
+// and only then checked against [low, high] - so every instantiation is
+// vectorized by the compiler for its own element type.
+// A kernel returns false as soon as a tile holds a value outside the range
+// (the rest of the destination is then left unspecified). Under the Checked
+// policy a result that overflows the element type is outside the range too.
+namespace ElementKernels
+{
+	// The type the values of T are computed in: int for the integers
+	// narrower than int, so that no result overflows before it is checked
+	template <typename T>
+	using Wide = std::conditional_t<std::is_integral_v<T> && (sizeof(T) < sizeof(int)), int, T>;
+
+	// Whether a result computed in Wide<T> may overflow it (int64)
+	template <typename T>
+	constexpr bool CAN_OVERFLOW = std::is_integral_v<T> && std::is_same_v<Wide<T>, T>;
+
+	// a / b rounded down, or up; b is neither 0 nor -1
+	template <typename W>
+	W divideRounding(W a, W b, bool up)
+	{
+		const W quotient = a / b;
+		if (a % b == 0)
+			return quotient;
+		// The quotient was truncated toward zero
+		const bool negative = (a < 0) != (b < 0);
+		if (negative && !up)
+			return quotient - 1;
+		if (!negative && up)
+			return quotient + 1;
+		return quotient;
+	}
+
+	// The bounds a value x of the integer type W is within exactly when
+	// x * scalar is within [low, high], so a product that would overflow W
+	// is caught by checking x (the int kernels of MatrixKernels use it too)
+	template <typename W>
+	std::pair<W, W> scaledSourceBounds(W scalar, W low, W high)
+	{
+		if (scalar == 0)
+			return { std::numeric_limits<W>::lowest(), std::numeric_limits<W>::max() };
+		if (scalar == -1)
+			return { static_cast<W>(-high),
+			         low == std::numeric_limits<W>::lowest() ? std::numeric_limits<W>::max() : static_cast<W>(-low) };
+		if (scalar > 0)
+			return { divideRounding(low, scalar, true), divideRounding(high, scalar, false) };
+		return { divideRounding(high, scalar, true), divideRounding(low, scalar, false) };
+	}
+
+	// op(a, b) in W; integers wrap around instead of overflowing
+	template <typename W, typename Op>
+	W wrapping(W a, W b, Op op)
+	{
+		if constexpr (std::is_integral_v<W>)
+		{
+			using Unsigned = std::make_unsigned_t<W>;
+			return static_cast<W>(op(static_cast<Unsigned>(a), static_cast<Unsigned>(b)));
+		}
+		else
+		{
+			return op(a, b);
+		}
+	}
+
+	// dst[i] = value(i, overflow) for every i < count, tile by tile; a value
+	// that overflowed sets the sign bit of 'overflow'
+	template <typename T, typename Value>
+	bool apply(T* dst, std::size_t count, Wide<T> low, Wide<T> high, Value value)
+	{
+		for (std::size_t begin = 0; begin < count; begin += ELEMENT_TILE)
+		{
+			const std::size_t end = std::min(count, begin + ELEMENT_TILE);
+			Wide<T> tileLow = high, tileHigh = low;
+			std::uint64_t overflow = 0;
+			for (std::size_t i = begin; i < end; ++i)
+			{
+				const Wide<T> result = value(i, overflow);
+				tileLow = std::min(tileLow, result);
+				tileHigh = std::max(tileHigh, result);
+				dst[i] = static_cast<T>(result);
+			}
+			if (tileLow < low || tileHigh > high || overflow >> 63 != 0)
+				return false;
+		}
+		return true;
+	}
+
+	// lhs +/- rhs; a sum overflowed when its sign differs from that of both
+	// operands, a difference when lhs differs in sign from rhs and from it
+	template <typename T, typename Op>
+	bool addOrSub(T* dst, const T* lhs, const T* rhs, std::size_t count, Wide<T> low, Wide<T> high,
+	              RangePolicy policy, Op op)
+	{
+		[[maybe_unused]] const std::uint64_t detect = policy == RangePolicy::Checked ? ~std::uint64_t{} : 0;
+		return apply(dst, count, low, high, [&](std::size_t i, [[maybe_unused]] std::uint64_t& overflow)
+		{
+			const Wide<T> result = wrapping<Wide<T>>(lhs[i], rhs[i], op);
+			if constexpr (CAN_OVERFLOW<T>)
+			{
+				const auto bits = [](T value) { return static_cast<std::uint64_t>(static_cast<std::int64_t>(value)); };
+				const std::uint64_t a = bits(lhs[i]), b = bits(rhs[i]), r = bits(result);
+				if constexpr (std::is_same_v<Op, std::minus<>>)
+					overflow |= (a ^ b) & (a ^ r) & detect;
+				else
+					overflow |= (a ^ r) & (b ^ r) & detect;
+			}
+			return result;
+		});
+	}
+
+	template <typename T>
+	bool add(T* dst, const T* lhs, const T* rhs, std::size_t count, Wide<T> low, Wide<T> high,
+	         RangePolicy policy)
+	{
+		return addOrSub(dst, lhs, rhs, count, low, high, policy, std::plus<>());
+	}
+
+	template <typename T>
+	bool sub(T* dst, const T* lhs, const T* rhs, std::size_t count, Wide<T> low, Wide<T> high,
+	         RangePolicy policy)
+	{
+		return addOrSub(dst, lhs, rhs, count, low, high, policy, std::minus<>());
+	}
+
+	// A product that may overflow is checked through its source instead
+	template <typename T>
+	bool scale(T* dst, const T* src, T scalar, std::size_t count, Wide<T> low, Wide<T> high,
+	           RangePolicy policy)
+	{
+		std::pair<Wide<T>, Wide<T>> source{ std::numeric_limits<Wide<T>>::lowest(), std::numeric_limits<Wide<T>>::max() };
+		if constexpr (CAN_OVERFLOW<T>)
+		{
+			if (policy == RangePolicy::Checked)
+				source = scaledSourceBounds<T>(scalar, low, high);
+		}
+		return apply(dst, count, low, high, [&](std::size_t i, [[maybe_unused]] std::uint64_t& overflow)
+		{
+			if constexpr (CAN_OVERFLOW<T>)
+				overflow |= std::uint64_t{ src[i] < source.first || src[i] > source.second } << 63;
+			return wrapping<Wide<T>>(src[i], scalar, std::multiplies<>());
+		});
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// The element types matrices can be evaluated in
+enum class ElementType
+{
+	Int16,
+	Int,
+	Int64,
+	Float,
+	Double,
+};
+
+// The C++ types of the element types, in the order of ElementType
+using ElementTypeList = std::tuple<std::int16_t, int, std::int64_t, float, double>;
+
+// The names of the element types, as commands and options take them
+constexpr std::array<std::string_view, std::tuple_size_v<ElementTypeList>> ELEMENT_TYPE_NAMES =
+	{ "int16", "int", "int64", "float", "double" };
+
+//-----------------------------------------------------------------------------
+
+constexpr std::string_view elementTypeName(ElementType type)
+{
+	return ELEMENT_TYPE_NAMES[static_cast<std::size_t>(type)];
+}
+
+//-----------------------------------------------------------------------------
+
+constexpr std::optional<ElementType> findElementType(std::string_view name)
+{
+	for (std::size_t i = 0; i < ELEMENT_TYPE_NAMES.size(); ++i)
+	{
+		if (ELEMENT_TYPE_NAMES[i] == name)
+			return static_cast<ElementType>(i);
+	}
+	return std::nullopt;
+}
+
+//-----------------------------------------------------------------------------
+
+// Calls f.template operator()<T>() with the C++ type T of 'type'
+template <typename Function>
+decltype(auto) dispatchElementType(ElementType type, Function&& f)
+{
+	switch (type)
+	{
+		case ElementType::Int16: return f.template operator()<std::int16_t>();
+		case ElementType::Int:   return f.template operator()<int>();
+		case ElementType::Int64: return f.template operator()<std::int64_t>();
+		case ElementType::Float: return f.template operator()<float>();
+		default:                 return f.template operator()<double>();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Calls f.template operator()<T>() with every C++ type T of ElementTypeList
+template <typename Function>
+void forEachElementType(Function&& f)
+{
+	[&]<typename... T>(std::type_identity<std::tuple<T...>>)
+	{
+		(f.template operator()<T>(), ...);
+	}(std::type_identity<ElementTypeList>{});
+}
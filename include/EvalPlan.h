@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Operation.h"
+#include "FusedExpression.h"
+
+#include <cstddef>
+#include <map>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+// An operation tree compiled, for one matrix size, into a straight-line list
+// of kernel calls over numbered matrix slots: slots [0, inputCount) are the
+// inputs and the others are buffers. The steps are in dependency order and
+// the buffers are assigned by liveness - a buffer is reused as soon as the
+// value it holds has been read for the last time - so run() allocates only
+// as many matrices as are ever alive together.
+// Each step is a fused element-wise program (see FusedExpression) or a
+// matrix product.
+// The steps are planned once, when the plan is built: an operation the DAG
+// reaches again with the same operand slots is not planned twice, its
+// earlier value is used, so a run never looks at the input values.
+class EvalPlan
+{
+public:
+    using T = Operation::T;
+
+    // The buffers of a run, kept by the caller so that its later runs of
+    // the plan do not allocate. Everything a run allocates comes from the
+    // workspace's memory resource. One thread at a time may use a workspace.
+    struct Workspace
+    {
+        Workspace() = default;
+        explicit Workspace(std::pmr::memory_resource* resource) : buffers(resource), sources(resource) {}
+
+        std::pmr::vector<T> buffers;
+        std::pmr::vector<const T*> sources;
+    };
+
+    EvalPlan(const Operation& operation, std::size_t size);
+
+    T run(std::span<const T> input) const;
+    // The result lives in 'workspace' (or is one of the inputs) until its next run
+    const T& run(std::span<const T> input, Workspace& workspace) const;
+
+    // Number of matrices run() allocates (the result included)
+    std::size_t bufferCount() const { return m_schedule.bufferCount; }
+
+private:
+    enum class Kernel { Fused, Product };
+
+    struct Step
+    {
+        Kernel kernel;
+        std::size_t expression = 0; // into m_expressions, for Fused
+        std::vector<std::size_t> operands;
+        std::size_t output = 0;
+    };
+
+    // The steps to execute, with slots instead of values
+    struct Schedule
+    {
+        std::vector<Step> steps;
+        std::size_t bufferCount = 0;
+        std::size_t result = 0;
+    };
+
+    // The value computed by each operation planned so far, by its operand slots
+    using Planned = std::map<std::pair<const Operation*, std::vector<std::size_t>>, std::size_t>;
+
+    // Returns the value holding the result of 'operation' on the values
+    // 'inputs', planning its steps unless 'planned' already has it
+    std::size_t plan(const Operation& operation, std::span<const std::size_t> inputs,
+                     Planned& planned);
+    // Appends to m_schedule.steps the steps computing 'operation'
+    std::size_t planSteps(const Operation& operation, std::span<const std::size_t> inputs,
+                          Planned& planned);
+    std::size_t addStep(Step step);
+    void assignBuffers();
+    // Returns the slot of the result
+    std::size_t execute(std::span<const T> input, Workspace& workspace) const;
+
+    std::size_t m_size;
+    std::size_t m_inputCount;
+    std::size_t m_valueCount;
+    std::vector<FusedExpression> m_expressions;
+    Schedule m_schedule;
+};
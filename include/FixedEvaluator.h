@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include "FixedSquareMatrix.h"
+#include "InputSpan.h"
+#include "OperationVisitor.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "Mul.h"
+#include "Comp.h"
+
+// Evaluates an operation tree on N x N int matrices held in FixedSquareMatrix,
+// walking the tree with the visitor instead of Operation::compute, so nothing
+// is allocated: every intermediate lives on the stack.
+// The results and the range checks are the same as compute() on SquareMatrix.
+template <std::size_t N>
+class FixedEvaluator : public OperationVisitor
+{
+public:
+	using Matrix = FixedSquareMatrix<int, N>;
+	using Inputs = InputSpan<Matrix>;
+
+	Matrix evaluate(const Operation& operation, Inputs input);
+
+	void visit(const Identity& operation) override;
+	void visit(const Transpose& operation) override;
+	void visit(const Scalar& operation) override;
+	void visit(const Add& operation) override;
+	void visit(const Sub& operation) override;
+	void visit(const Mul& operation) override;
+	void visit(const Comp& operation) override;
+
+private:
+	template <typename Combine>
+	void visitBinary(const BinaryOperation& operation, Combine combine);
+
+	// The inputs of the node being visited
+	Inputs m_input = Inputs(std::span<const Matrix>());
+	Matrix m_result;
+};
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+typename FixedEvaluator<N>::Matrix FixedEvaluator<N>::evaluate(const Operation& operation, Inputs input)
+{
+	m_input = input;
+	operation.accept(*this);
+	return m_result;
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Identity& operation)
+{
+	(void)operation;
+	m_result = m_input.front();
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Transpose& operation)
+{
+	(void)operation;
+	m_result = m_input.front().Transpose();
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Scalar& operation)
+{
+	m_result = m_input.front().scaleChecked(operation.scalar());
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+template <typename Combine>
+void FixedEvaluator<N>::visitBinary(const BinaryOperation& operation, Combine combine)
+{
+	const Inputs input = m_input;
+	const Matrix a = evaluate(*operation.first(), input);
+	const Matrix b = evaluate(*operation.second(), input.subspan(operation.secondOffset()));
+	m_result = combine(a, b);
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Add& operation)
+{
+	visitBinary(operation, [](const Matrix& a, const Matrix& b) { return a.addChecked(b); });
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Sub& operation)
+{
+	visitBinary(operation, [](const Matrix& a, const Matrix& b) { return a.subChecked(b); });
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Mul& operation)
+{
+	visitBinary(operation, [](const Matrix& a, const Matrix& b) { return a.multiplyChecked(b); });
+}
+
+//-----------------------------------------------------------------------------
+
+// The result of the first operation is the first input of the second one
+template <std::size_t N>
+void FixedEvaluator<N>::visit(const Comp& operation)
+{
+	const Inputs input = m_input;
+	const Matrix resultOfFirst = evaluate(*operation.first(), input);
+	m_result = evaluate(*operation.second(), Inputs(resultOfFirst, input.subspan(operation.secondOffset())));
+}
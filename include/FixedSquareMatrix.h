@@ -0,0 +1,353 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <span>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "SquareMatrix.h"
+
+// Largest size evaluated with FixedSquareMatrix instead of SquareMatrix
+const std::size_t MAX_FIXED_MAT_SIZE = 8;
+
+// Square matrix whose size is a compile-time constant, stored inline in a
+// std::array - no heap allocation, and every element-wise operation is a fold
+// over the N*N elements that the compiler fully unrolls.
+// The operators do not check the allowed range; the *Checked versions compute
+// every element exactly in GemmTraits<T>::Tile and check it before it is
+// narrowed to T, so an int result that overflows is caught whatever the range.
+template <typename T, std::size_t N>
+class FixedSquareMatrix
+{
+public:
+	constexpr FixedSquareMatrix() = default;
+
+	static constexpr std::size_t size() { return N; }
+
+	constexpr T& operator()(std::size_t i, std::size_t j) { return m_data[i * N + j]; }
+	constexpr const T& operator()(std::size_t i, std::size_t j) const { return m_data[i * N + j]; }
+	MatrixView<const T> view() const { return MatrixView<const T>(m_data.data(), N, N, N); }
+
+	constexpr FixedSquareMatrix operator+(const FixedSquareMatrix& rhs) const;
+	constexpr FixedSquareMatrix operator-(const FixedSquareMatrix& rhs) const;
+	constexpr FixedSquareMatrix operator*(const T& scalar) const;
+	constexpr FixedSquareMatrix operator*(const FixedSquareMatrix& rhs) const;
+	constexpr FixedSquareMatrix Transpose() const;
+
+	// Matrix product whose exact dot products are range-checked before they
+	// are narrowed to T, like the GEMM kernel does per output tile
+	FixedSquareMatrix multiplyChecked(const FixedSquareMatrix& rhs) const;
+	FixedSquareMatrix addChecked(const FixedSquareMatrix& rhs) const;
+	FixedSquareMatrix subChecked(const FixedSquareMatrix& rhs) const;
+	FixedSquareMatrix scaleChecked(const T& scalar) const;
+
+	// Throws the same std::out_of_range as SquareMatrix<T> under its policy
+	void checkValidRange() const;
+
+private:
+	using Elements = std::make_index_sequence<N * N>;
+	using Tile = typename GemmTraits<T>::Tile;
+	using Wide = std::array<Tile, N * N>;
+
+	// 'overflow' gets the sign bit set when an integer sum overflows Tile
+	constexpr Wide wideProduct(const FixedSquareMatrix& rhs, std::uint64_t& overflow) const;
+	template <std::size_t... K>
+	constexpr Tile dot(const FixedSquareMatrix& rhs, std::size_t i, std::uint64_t& overflow,
+	                   std::index_sequence<K...>) const;
+	template <typename Op>
+	Wide wideElements(Op op) const;
+	static constexpr FixedSquareMatrix narrow(const Wide& wide);
+	// Throws the range error of SquareMatrix<T> under its Checked policy
+	static FixedSquareMatrix narrowChecked(const Wide& wide, std::uint64_t overflow);
+
+	template <typename Op, std::size_t... I>
+	static constexpr FixedSquareMatrix generate(Op op, std::index_sequence<I...>);
+
+	// Integer arithmetic wraps, like the SquareMatrix kernels
+	template <typename V>
+	static constexpr V add(V a, V b);
+	template <typename V>
+	static constexpr V sub(V a, V b);
+	template <typename V>
+	static constexpr V mul(V a, V b);
+
+	std::array<T, N * N> m_data{};
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+template <typename Op, std::size_t... I>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::generate(Op op, std::index_sequence<I...>)
+{
+	FixedSquareMatrix result;
+	((result.m_data[I] = op(I)), ...);
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+template <typename V>
+constexpr V FixedSquareMatrix<T, N>::add(V a, V b)
+{
+	if constexpr (std::is_integral_v<V>)
+	{
+		using U = std::make_unsigned_t<V>;
+		return static_cast<V>(static_cast<U>(a) + static_cast<U>(b));
+	}
+	else return a + b;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+template <typename V>
+constexpr V FixedSquareMatrix<T, N>::sub(V a, V b)
+{
+	if constexpr (std::is_integral_v<V>)
+	{
+		using U = std::make_unsigned_t<V>;
+		return static_cast<V>(static_cast<U>(a) - static_cast<U>(b));
+	}
+	else return a - b;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+template <typename V>
+constexpr V FixedSquareMatrix<T, N>::mul(V a, V b)
+{
+	if constexpr (std::is_integral_v<V>)
+	{
+		using U = std::make_unsigned_t<V>;
+		return static_cast<V>(static_cast<U>(a) * static_cast<U>(b));
+	}
+	else return a * b;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::operator+(const FixedSquareMatrix& rhs) const
+{
+	return generate([&](std::size_t i) { return add(m_data[i], rhs.m_data[i]); }, Elements{});
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::operator-(const FixedSquareMatrix& rhs) const
+{
+	return generate([&](std::size_t i) { return sub(m_data[i], rhs.m_data[i]); }, Elements{});
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::operator*(const T& scalar) const
+{
+	return generate([&](std::size_t i) { return mul(m_data[i], scalar); }, Elements{});
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::Transpose() const
+{
+	return generate([&](std::size_t i) { return m_data[i % N * N + i / N]; }, Elements{});
+}
+
+//-----------------------------------------------------------------------------
+
+// Dot product of row i / N of this matrix and column i % N of rhs; integers
+// are summed in (wrapping) unsigned, like GemmTraits<int>, so unchecked
+// values wrap instead of overflowing and an overflow of the sum is detected
+template <typename T, std::size_t N>
+template <std::size_t... K>
+constexpr typename FixedSquareMatrix<T, N>::Tile
+FixedSquareMatrix<T, N>::dot(const FixedSquareMatrix& rhs, std::size_t i, std::uint64_t& overflow,
+                             std::index_sequence<K...>) const
+{
+	if constexpr (std::is_integral_v<Tile>)
+	{
+		const auto element = [](T value) { return static_cast<std::uint64_t>(static_cast<Tile>(value)); };
+		std::uint64_t sum = 0;
+		((sum = addDetectingOverflow(sum, element(m_data[i / N * N + K]) * element(rhs.m_data[K * N + i % N]),
+		                             overflow)), ...);
+		return static_cast<Tile>(sum);
+	}
+	else return (Tile{} + ... + (static_cast<Tile>(m_data[i / N * N + K]) *
+	                             static_cast<Tile>(rhs.m_data[K * N + i % N])));
+}
+
+//-----------------------------------------------------------------------------
+
+// All N*N dot products in Tile, one unrolled fold per element
+template <typename T, std::size_t N>
+constexpr typename FixedSquareMatrix<T, N>::Wide
+FixedSquareMatrix<T, N>::wideProduct(const FixedSquareMatrix& rhs, std::uint64_t& overflow) const
+{
+	Wide wide{};
+	[&]<std::size_t... I>(std::index_sequence<I...>)
+	{
+		((wide[I] = dot(rhs, I, overflow, std::make_index_sequence<N>{})), ...);
+	}(Elements{});
+	return wide;
+}
+
+//-----------------------------------------------------------------------------
+
+// op(i) for every element, in Tile: exact for the sums and products of ints
+template <typename T, std::size_t N>
+template <typename Op>
+typename FixedSquareMatrix<T, N>::Wide FixedSquareMatrix<T, N>::wideElements(Op op) const
+{
+	Wide wide{};
+	[&]<std::size_t... I>(std::index_sequence<I...>)
+	{
+		((wide[I] = op(I)), ...);
+	}(Elements{});
+	return wide;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::narrow(const Wide& wide)
+{
+	return generate([&](std::size_t i) { return static_cast<T>(wide[i]); }, Elements{});
+}
+
+//-----------------------------------------------------------------------------
+
+// Checked results must not have overflowed Tile either
+template <typename T, std::size_t N>
+FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::narrowChecked(const Wide& wide, std::uint64_t overflow)
+{
+	if (SquareMatrix<T>::rangePolicy() == RangePolicy::Checked)
+	{
+		const Tile low = SquareMatrix<T>::template lowBound<Tile>();
+		const Tile high = SquareMatrix<T>::template highBound<Tile>();
+		bool inRange = overflow >> 63 == 0;
+		for (const auto value : wide)
+		{
+			inRange = inRange && value >= low && value <= high;
+		}
+		if (!inRange)
+		{
+			throw std::out_of_range(RANGE_ERROR_MESSAGE);
+		}
+	}
+	return narrow(wide);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+constexpr FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::operator*(const FixedSquareMatrix& rhs) const
+{
+	std::uint64_t overflow = 0;
+	return narrow(wideProduct(rhs, overflow));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::multiplyChecked(const FixedSquareMatrix& rhs) const
+{
+	std::uint64_t overflow = 0;
+	const Wide wide = wideProduct(rhs, overflow);
+	return narrowChecked(wide, overflow);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::addChecked(const FixedSquareMatrix& rhs) const
+{
+	return narrowChecked(wideElements([&](std::size_t i)
+	{
+		return add<Tile>(m_data[i], rhs.m_data[i]);
+	}), 0);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::subChecked(const FixedSquareMatrix& rhs) const
+{
+	return narrowChecked(wideElements([&](std::size_t i)
+	{
+		return sub<Tile>(m_data[i], rhs.m_data[i]);
+	}), 0);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+FixedSquareMatrix<T, N> FixedSquareMatrix<T, N>::scaleChecked(const T& scalar) const
+{
+	return narrowChecked(wideElements([&](std::size_t i)
+	{
+		return mul<Tile>(m_data[i], scalar);
+	}), 0);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T, std::size_t N>
+void FixedSquareMatrix<T, N>::checkValidRange() const
+{
+	if (SquareMatrix<T>::rangePolicy() == RangePolicy::Unchecked) return;
+
+	const T low = SquareMatrix<T>::template lowBound<T>();
+	const T high = SquareMatrix<T>::template highBound<T>();
+	const bool inRange = [&]<std::size_t... I>(std::index_sequence<I...>)
+	{
+		return ((m_data[I] >= low && m_data[I] <= high) && ...);
+	}(Elements{});
+
+	if (!inRange)
+	{
+		throw std::out_of_range(RANGE_ERROR_MESSAGE);
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t N>
+std::ostream& operator<<(std::ostream& ostr, const FixedSquareMatrix<int, N>& matrix)
+{
+	MatrixFormatter::local().write(ostr, matrix.view());
+	return ostr;
+}
+
+//-----------------------------------------------------------------------------
+
+// Same validation and messages as operator>> for SquareMatrix<int>
+template <std::size_t N>
+std::istream& operator>>(std::istream& istr, FixedSquareMatrix<int, N>& matrix)
+{
+	// The rows are contiguous, so the matrix is read in one go
+	IntegerReader(istr).read(std::span<int>(&matrix(0, 0), N * N),
+	                         SquareMatrix<int>::lowBound<int>(), SquareMatrix<int>::highBound<int>());
+	return istr;
+}
+
+//-----------------------------------------------------------------------------
+
+// Calls f.template operator()<size>() when 1 <= size <= MAX_FIXED_MAT_SIZE;
+// returns whether a fixed-size path handled the size
+template <typename Function>
+bool dispatchFixedSize(std::size_t size, Function&& f)
+{
+	return [&]<std::size_t... I>(std::index_sequence<I...>)
+	{
+		return ((size == I + 1 && (f.template operator()<I + 1>(), true)) || ...);
+	}(std::make_index_sequence<MAX_FIXED_MAT_SIZE>{});
+}
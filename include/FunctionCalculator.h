@@ -1,8 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <span>
 #include <iosfwd>
 #include <optional>
 #include <iostream>
@@ -11,44 +14,68 @@
 
 #include "Read.h"
 #include "Utility.h"
+#include "CalculatorOptions.h"
+#include "CommandLine.h"
+#include "EvalPlan.h"
+#include "MatrixPool.h"
+#include "OperationRegistry.h"
 #include "ReadException.h"
 #include "FileException.h"
 #include "OperationExceptionRange.h"
 #include "OperationExceptionDigit.h"
 
-const int MAX_MAT_SIZE = 5;
-
 enum t_numArgs
 {
     ZERO_ARGS,
     ONE_ARGS,
-    TWO_ARGS
+    TWO_ARGS,
+    THREE_ARGS
 };
 
 class Operation;
-
+class MatrixFile;
+struct BatchReport;
+
+// A calculator session: reads commands from 'istr' and prints to 'ostr'.
+// The operations live in an OperationRegistry, which several sessions may
+// share; a session works on the snapshot it took when it last prompted for
+// a command (and on the ones its own changes published), and sees the
+// changes of other sessions from its next prompt on.
 class FunctionCalculator
 {
 public:
-    FunctionCalculator(std::istream& istr, std::ostream& ostr);
+    FunctionCalculator(std::istream& istr, std::ostream& ostr,
+                       const CalculatorOptions& options = {});
+    FunctionCalculator(std::istream& istr, std::ostream& ostr,
+                       std::shared_ptr<OperationRegistry> registry,
+                       const CalculatorOptions& options = {});
+    // Runs until the exit command or the end of the input
     void run();
     
     void executeCommand();
-    void setStreams(std::string input);
+    void setStreams(std::string_view input);
 
 private:
-    struct ActionDetails
-    {
-        std::string command;
-        std::string description;
-        Action action;
-    };
-
-    using ActionMap = std::vector<ActionDetails>;
-    using OperationList = std::vector<std::shared_ptr<Operation>>;
-
-    void eval();
+    using Snapshot = OperationRegistry::Snapshot;
+    // Compiled plans by (evaluated operation, matrix size); a key keeps its
+    // operation alive, so it is never confused with a later one
+    using PlanCache = std::map<std::pair<std::shared_ptr<Operation>, std::size_t>, EvalPlan>;
+
+    // profiled: computes node by node and prints the counters of each node
+    void eval(bool profiled = false);
+    void evalProfiled(const Operation& evaluated, std::span<const Operation::T> input);
+    template <typename T>
+    void evalAs(const Operation& operation, const Operation& evaluated, std::size_t size, bool profiled);
+    template <std::size_t N>
+    void evalFixed(const Operation& operation, const Operation& evaluated, int inputCount);
+    const EvalPlan& getPlan(const std::shared_ptr<Operation>& evaluated, std::size_t size);
+    void evalBatch();
+    template <typename Run>
+    BatchReport batchWith(std::size_t index, std::size_t size, Run run);
+    void convert();
+    MatrixFile openMatrixFile(const std::string& pathName, std::size_t size) const;
     void del();
+    void stats();
     void help() const;
     void exit();
     void getMaxOperation();
@@ -64,12 +91,18 @@ private:
     void runAction(Action action);
     void validDigit(int& value);
     int getNumber();
-    int getSizeMat();
-    int readOperationIndex();
+    std::size_t getSizeMat();
+    std::size_t readOperationIndex();
     bool startDel(int value);
     Action readAction();
-    ActionMap createActions() const;
-    OperationList createOperations() const;
+    void addOperation(const std::shared_ptr<Operation>& operation,
+                      const std::shared_ptr<Operation>& evaluated);
+    void checkOperationLimit(const Snapshot& snapshot) const;
+    // Takes 'snapshot' as the operations to work on
+    void setSnapshot(std::shared_ptr<const Snapshot> snapshot);
+    // Publishes change(Snapshot&) to the registry and works on the result
+    template <typename Change>
+    void commit(Change change);
 
 	template <typename ErrorType>
     void throwError(const std::string& message) const;
@@ -82,14 +115,22 @@ private:
     template <typename FuncType>
     void unaryWithIntFunc();
 
-    OperationList m_operations;
+    std::shared_ptr<OperationRegistry> m_registry;
+    std::shared_ptr<const Snapshot> m_snapshot;
+    PlanCache m_plans;
+    // The buffers of past evals, reused by the next ones
+    MatrixPool m_pool;
+    // Matrix bytes held at once by the last eval (on top of what was held before it)
+    std::size_t m_lastEvalPeakBytes = 0;
+    // The scripts being read, outermost first
+    std::vector<std::string> m_scripts;
     std::istream& m_istr;
     std::ostream& m_ostr;
-    std::istringstream m_iss;
+    // The command being run, split into its tokens
+    CommandLine m_command;
 	Action m_currInput;
-    const ActionMap m_actions;
+    const CalculatorOptions m_options;
     bool m_running = true;
-	int m_maxOperation;
 };
 
 //-----------------------------------------------------------------------------
@@ -113,22 +154,25 @@ void FunctionCalculator::throwMatrix(std::string message) const
 
 //-----------------------------------------------------------------------------
 
+template <typename Change>
+void FunctionCalculator::commit(Change change)
+{
+    setSnapshot(m_registry->commit(change));
+}
+
+//-----------------------------------------------------------------------------
+
 template <typename FuncType>
 void FunctionCalculator::binaryFunc()
 {
     validNumOfArguments(2);
-    int f0 = readOperationIndex(), f1 = readOperationIndex();
-
-    if (m_operations.size() >= m_maxOperation)
-    {
-        std::string message = "You have exceeded the limits of the number"
-            " of the operations! Returning...\n";
+    const std::size_t f0 = readOperationIndex(), f1 = readOperationIndex();
+    checkOperationLimit(*m_snapshot);
 
-        throwError<std::out_of_range>(message);
-    }
-
-    m_operations.push_back(std::make_shared<FuncType>(m_operations[f0],
-                                                      m_operations[f1]));
+    const auto& operations = m_snapshot->operations;
+    const auto& evaluated = m_snapshot->evaluated;
+    addOperation(makeOperation<FuncType>(operations[f0], operations[f1]),
+                 makeOperation<FuncType>(evaluated[f0], evaluated[f1]));
 }
 
 //-----------------------------------------------------------------------------
@@ -136,7 +180,8 @@ void FunctionCalculator::binaryFunc()
 template <typename FuncType>
 void FunctionCalculator::unaryFunc()
 {
-    m_operations.push_back(std::make_shared<FuncType>());
+    const auto operation = makeOperation<FuncType>();
+    addOperation(operation, operation);
 }
 
 //-----------------------------------------------------------------------------
@@ -145,19 +190,16 @@ template <typename FuncType>
 void FunctionCalculator::unaryWithIntFunc()
 {
     validNumOfArguments(ONE_ARGS);
-    if (m_operations.size() >= m_maxOperation)
-    {
-        throwError<std::out_of_range>("You have exceeded the limits of the number"
-            " of the operations! Returning...\n");
-    }
+    checkOperationLimit(*m_snapshot);
 
     int i = 0;
     validDigit(i);
 
     if (i < MIN_ALLOWED_VALUE || i > MAX_ALLOWED_VALUE)
     {
-        throwError<std::out_of_range>("Value is out of the allowed range!");
+        throwError<std::out_of_range>(RANGE_ERROR_MESSAGE);
     }
 
-    m_operations.push_back(std::make_shared<FuncType>(i));
+    const auto operation = makeOperation<FuncType>(i);
+    addOperation(operation, operation);
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Operation.h"
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Elements computed per tile of a fused evaluation (a few of these tiles,
+// one per pending intermediate, stay in L1)
+const std::size_t FUSED_TILE = 1024;
+// Side of the square tiles used when the expression reads a transposed input
+const std::size_t FUSED_BLOCK = 32;
+
+// An operation tree built from Identity, Transpose, Scalar, Add, Sub and Comp,
+// compiled into one element-wise program: every tile of the result is
+// computed through the whole tree before the next one, so each input is read
+// once and only the result is written to memory.
+// A transpose is pushed down to the inputs it applies to. Any other node
+// (Mul) is computed on its own and its result is read like an input.
+// Every intermediate result is range-checked, like in the per-node compute().
+class FusedExpression
+{
+public:
+    using T = Operation::T;
+
+    // Returns nullopt when the root itself is not fusable: a Mul, or a Comp
+    // that hands its first result to a Mul
+    static std::optional<FusedExpression> compile(const Operation& root);
+
+    T evaluate(Operation::Inputs input) const;
+
+    // A matrix read by the program: input[offset], or the result of 'opaque'
+    // on the inputs starting at input[offset]
+    struct Source
+    {
+        const Operation* opaque = nullptr;
+        std::size_t offset = 0;
+    };
+
+    const std::vector<Source>& sources() const { return m_sources; }
+
+    // Runs the program with sources()[i] read from *sources[i]. The result may
+    // be one of the sources unless readsTransposed().
+    void run(std::span<const T* const> sources, T& result) const;
+
+    bool readsTransposed() const { return m_transposes; }
+    // The program is a lone Load: the result is a copy of its source
+    bool copiesSource() const { return m_program.size() == 1 && !m_transposes; }
+
+private:
+    enum class OpCode { Load, Scale, Add, Sub };
+
+    // Postfix program over a stack of tiles
+    struct Instruction
+    {
+        OpCode code;
+        std::size_t source = 0;
+        bool transposed = false;
+        int scalar = 0;
+    };
+
+    class Compiler;
+
+    void evaluateFlat(std::span<const T* const> sources, T& result) const;
+    void evaluateBlocked(std::span<const T* const> sources, T& result) const;
+    template <typename Load>
+    bool runTile(Load load, std::size_t count, int* output) const;
+
+    std::vector<Instruction> m_program;
+    std::vector<Source> m_sources;
+    std::size_t m_depth = 0;
+    bool m_transposes = false;
+};
@@ -0,0 +1,324 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "MatrixView.h"
+#include "Utility.h"
+
+// Cache-tiled matrix multiplication C = A * B (Goto/BLIS structure):
+//   - a column block of B (all of K x GEMM_NC) is packed into NR-wide panels,
+//   - a GEMM_MC x GEMM_KC block of A is packed into MR-high panels,
+//   - an MR x NR register-blocked micro-kernel walks both panels linearly.
+// Every GEMM_MC x GEMM_NC output tile is accumulated in a wide scratch tile
+// and checked against [low, high] once, when it is complete. Under the
+// Checked policy a sum or product that overflows is outside the range too.
+
+const std::size_t GEMM_MR = 4;
+const std::size_t GEMM_NR = 16;
+const std::size_t GEMM_MC = 64;
+const std::size_t GEMM_KC = 256;
+const std::size_t GEMM_NC = 128;
+
+// Panel: accumulator of one GEMM_KC slice, kept in registers.
+// Tile: accumulator of a whole dot product.
+// int panels accumulate in (wrapping) unsigned: with inputs in the default
+// allowed range a slice sum stays far below 2^31, and the tile sum is exact
+// in 64 bits (a wider range takes WideIntGemmTraits, see MatrixKernels::gemm).
+// int16 panels accumulate in 64 bits, as a product of two int16 values
+// already takes 31. int64 sums wrap in 64 bits, and CHECKS_OVERFLOW has the
+// kernel detect when one does; CHECKS_PRODUCTS has it check the products
+// too when the operands are large enough for one to overflow.
+template <typename T>
+struct GemmTraits
+{
+	using Panel = T;
+	using Tile = T;
+	static constexpr bool CHECKS_OVERFLOW = false;
+	static constexpr bool CHECKS_PRODUCTS = false;
+	static Tile widen(Panel value) { return value; }
+};
+
+template <>
+struct GemmTraits<int>
+{
+	using Panel = unsigned;
+	using Tile = std::int64_t;
+	static constexpr bool CHECKS_OVERFLOW = false;
+	static constexpr bool CHECKS_PRODUCTS = false;
+	static Tile widen(Panel value) { return static_cast<int>(value); }
+};
+
+// int with an allowed range wide enough for a slice sum to pass 2^31:
+// products of two ints are exact in 64 bits, only their sums can overflow
+struct WideIntGemmTraits
+{
+	using Panel = std::uint64_t;
+	using Tile = std::int64_t;
+	static constexpr bool CHECKS_OVERFLOW = true;
+	static constexpr bool CHECKS_PRODUCTS = false;
+	static Tile widen(Panel value) { return static_cast<std::int64_t>(value); }
+};
+
+template <>
+struct GemmTraits<std::int16_t>
+{
+	using Panel = std::uint64_t;
+	using Tile = std::int64_t;
+	static constexpr bool CHECKS_OVERFLOW = false;
+	static constexpr bool CHECKS_PRODUCTS = false;
+	static Tile widen(Panel value) { return static_cast<std::int64_t>(value); }
+};
+
+template <>
+struct GemmTraits<std::int64_t>
+{
+	using Panel = std::uint64_t;
+	using Tile = std::int64_t;
+	static constexpr bool CHECKS_OVERFLOW = true;
+	static constexpr bool CHECKS_PRODUCTS = true;
+	static Tile widen(Panel value) { return static_cast<std::int64_t>(value); }
+};
+
+//-----------------------------------------------------------------------------
+
+// sum = a + b, wrapping; when the signed sum overflows, sets the sign bit of
+// 'overflow' (a and b have the same sign, and the sum the other one)
+inline std::uint64_t addDetectingOverflow(std::uint64_t a, std::uint64_t b, std::uint64_t& overflow)
+{
+	const std::uint64_t sum = a + b;
+	overflow |= (a ^ sum) & (b ^ sum);
+	return sum;
+}
+
+//-----------------------------------------------------------------------------
+
+// product = a * b, wrapping; when the signed product overflows, sets the sign
+// bit of 'overflow'. The division makes it slow: it is for the rare operands
+// too large for productsFit
+inline std::uint64_t mulDetectingOverflow(std::int64_t a, std::int64_t b, std::uint64_t& overflow)
+{
+	const std::uint64_t product = static_cast<std::uint64_t>(a) * static_cast<std::uint64_t>(b);
+	const bool overflowed = a == -1 ? b == std::numeric_limits<std::int64_t>::lowest()
+	                                : a != 0 && static_cast<std::int64_t>(product) / a != b;
+	overflow |= std::uint64_t{ overflowed } << 63;
+	return product;
+}
+
+//-----------------------------------------------------------------------------
+
+// Whether every product of an element of 'a' and an element of 'b' fits an
+// int64, from their largest magnitudes
+template <typename T>
+bool productsFit(MatrixView<const T> a, MatrixView<const T> b)
+{
+	const auto largest = [](MatrixView<const T> view)
+	{
+		std::uint64_t magnitude = 0;
+		for (std::size_t i = 0; i < view.rows(); ++i)
+		{
+			for (const T value : view.row(i))
+			{
+				const auto bits = static_cast<std::uint64_t>(value);
+				magnitude = std::max(magnitude, value < 0 ? 0 - bits : bits);
+			}
+		}
+		return magnitude;
+	};
+
+	const std::uint64_t maxA = largest(a);
+	return maxA == 0 || largest(b) <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) / maxA;
+}
+
+//-----------------------------------------------------------------------------
+
+// c = a * b one dot product at a time, every product and sum checked for
+// overflow; for the operands productsFit rejects
+template <typename T>
+bool gemmCheckingProducts(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c,
+                          std::int64_t low, std::int64_t high)
+{
+	for (std::size_t i = 0; i < a.rows(); ++i)
+	{
+		for (std::size_t j = 0; j < b.cols(); ++j)
+		{
+			std::uint64_t sum = 0, overflow = 0;
+			for (std::size_t p = 0; p < a.cols(); ++p)
+			{
+				sum = addDetectingOverflow(sum, mulDetectingOverflow(a(i, p), b(p, j), overflow), overflow);
+			}
+			const auto value = static_cast<std::int64_t>(sum);
+			if (overflow >> 63 != 0 || value < low || value > high) return false;
+			c(i, j) = static_cast<T>(value);
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Packs rows [0, rows) x cols [0, cols) of 'a' into MR-high panels
+// (panel-major, then column, then row), padding the last panel with zeros
+template <typename T>
+void packA(MatrixView<const T> a, T* packed)
+{
+	for (std::size_t ir = 0; ir < a.rows(); ir += GEMM_MR)
+	{
+		const std::size_t mr = std::min(GEMM_MR, a.rows() - ir);
+		for (std::size_t p = 0; p < a.cols(); ++p)
+		{
+			for (std::size_t i = 0; i < GEMM_MR; ++i)
+			{
+				*packed++ = i < mr ? a(ir + i, p) : T{};
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Packs 'b' into NR-wide panels (panel-major, then row, then column),
+// padding the last panel with zeros
+template <typename T>
+void packB(MatrixView<const T> b, T* packed)
+{
+	for (std::size_t jr = 0; jr < b.cols(); jr += GEMM_NR)
+	{
+		const std::size_t nr = std::min(GEMM_NR, b.cols() - jr);
+		for (std::size_t p = 0; p < b.rows(); ++p)
+		{
+			const T* row = b.row(p).data() + jr;
+			for (std::size_t j = 0; j < GEMM_NR; ++j)
+			{
+				*packed++ = j < nr ? row[j] : T{};
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// tile[i][j] += sum over p < kc of a[p][i] * b[p][j] for the mr x nr corner;
+// returns false when a sum overflowed (only if Traits::CHECKS_OVERFLOW)
+template <typename T, typename Traits = GemmTraits<T>>
+bool gemmMicroKernel(std::size_t kc, const T* a, const T* b,
+                     typename Traits::Tile* tile, std::size_t tileStride,
+                     std::size_t mr, std::size_t nr)
+{
+	using Panel = typename Traits::Panel;
+	Panel acc[GEMM_MR][GEMM_NR] = {};
+	// The sign bit is set once a sum overflows
+	std::uint64_t overflow = 0;
+
+	for (std::size_t p = 0; p < kc; ++p, a += GEMM_MR, b += GEMM_NR)
+	{
+		for (std::size_t i = 0; i < GEMM_MR; ++i)
+		{
+			const Panel ai = static_cast<Panel>(a[i]);
+			for (std::size_t j = 0; j < GEMM_NR; ++j)
+			{
+				if constexpr (Traits::CHECKS_OVERFLOW)
+					acc[i][j] = addDetectingOverflow(acc[i][j], ai * static_cast<Panel>(b[j]), overflow);
+				else
+					acc[i][j] += ai * static_cast<Panel>(b[j]);
+			}
+		}
+	}
+
+	for (std::size_t i = 0; i < mr; ++i)
+	{
+		for (std::size_t j = 0; j < nr; ++j)
+		{
+			auto& sum = tile[i * tileStride + j];
+			if constexpr (Traits::CHECKS_OVERFLOW)
+				sum = Traits::widen(addDetectingOverflow(static_cast<Panel>(sum), acc[i][j], overflow));
+			else
+				sum += Traits::widen(acc[i][j]);
+		}
+	}
+	return overflow >> 63 == 0;
+}
+
+//-----------------------------------------------------------------------------
+
+// c = a * b; returns false (leaving c partly written) when an output tile holds
+// a value outside [low, high]. a is M x K, b is K x N and c is M x N.
+// Under the Checked policy a sum that overflows Tile on the way is out of
+// range, even if the later terms would have brought it back.
+template <typename T, typename Traits = GemmTraits<T>>
+bool gemmBlocked(MatrixView<const T> a, MatrixView<const T> b, MatrixView<T> c,
+                 typename Traits::Tile low, typename Traits::Tile high, RangePolicy policy)
+{
+	using Tile = typename Traits::Tile;
+	const std::size_t m = a.rows(), k = a.cols(), n = b.cols();
+
+	if constexpr (Traits::CHECKS_PRODUCTS)
+	{
+		if (policy == RangePolicy::Checked && !productsFit(a, b))
+			return gemmCheckingProducts(a, b, c, low, high);
+	}
+
+	thread_local std::vector<T> packedA, packedB;
+	thread_local std::vector<Tile> tile;
+	packedA.resize(GEMM_MC * GEMM_KC);
+	packedB.resize(k * GEMM_NC);
+	tile.resize(GEMM_MC * GEMM_NC);
+
+	for (std::size_t jc = 0; jc < n; jc += GEMM_NC)
+	{
+		const std::size_t nc = std::min(GEMM_NC, n - jc);
+		packB(b.subview(0, jc, k, nc), packedB.data());
+
+		for (std::size_t ic = 0; ic < m; ic += GEMM_MC)
+		{
+			const std::size_t mc = std::min(GEMM_MC, m - ic);
+			std::fill(tile.begin(), tile.end(), Tile{});
+
+			for (std::size_t pc = 0; pc < k; pc += GEMM_KC)
+			{
+				const std::size_t kc = std::min(GEMM_KC, k - pc);
+				packA(a.subview(ic, pc, mc, kc), packedA.data());
+
+				for (std::size_t jr = 0; jr < nc; jr += GEMM_NR)
+				{
+					const T* bPanel = packedB.data() + jr * k + pc * GEMM_NR;
+					for (std::size_t ir = 0; ir < mc; ir += GEMM_MR)
+					{
+						if (!gemmMicroKernel<T, Traits>(kc, packedA.data() + ir * kc, bPanel,
+						                                tile.data() + ir * GEMM_NC + jr, GEMM_NC,
+						                                std::min(GEMM_MR, mc - ir), std::min(GEMM_NR, nc - jr)) &&
+						    policy == RangePolicy::Checked)
+						{
+							return false;
+						}
+					}
+				}
+			}
+
+			// The output tile is complete: one range check, then store
+			Tile minValue = high, maxValue = low;
+			for (std::size_t i = 0; i < mc; ++i)
+			{
+				const Tile* tileRow = tile.data() + i * GEMM_NC;
+				for (std::size_t j = 0; j < nc; ++j)
+				{
+					minValue = std::min(minValue, tileRow[j]);
+					maxValue = std::max(maxValue, tileRow[j]);
+				}
+			}
+			if (mc > 0 && nc > 0 && (minValue < low || maxValue > high)) return false;
+
+			for (std::size_t i = 0; i < mc; ++i)
+			{
+				const Tile* tileRow = tile.data() + i * GEMM_NC;
+				T* cRow = c.row(ic + i).data() + jc;
+				for (std::size_t j = 0; j < nc; ++j)
+				{
+					cRow[j] = static_cast<T>(tileRow[j]);
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -8,6 +8,7 @@ class Identity : public UnaryOperation
 {
 public:
     using UnaryOperation::UnaryOperation;
-	T compute(const std::vector<T>& input) const override;
+	T compute(Inputs input) const override;
+	void accept(OperationVisitor& visitor) const override;
     void print(std::ostream& ostr, bool first_print = false) const override;
 };
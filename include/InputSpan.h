@@ -0,0 +1,53 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <span>
+
+// The inputs of an operation: a view of consecutive matrices of the one input
+// array of an evaluation, optionally preceded by a "head" matrix that lives
+// elsewhere (the result of a Comp's first operation, which is the first input
+// of its second operation). Nothing is copied when it is split up.
+// A head given as an rvalue is owned: the one operation that reads it may
+// take its storage over (ownedFront). Every input is read by one leaf only,
+// so the head goes on to the first operand alone.
+template <typename T>
+class InputSpan
+{
+public:
+	InputSpan(std::span<const T> inputs) : m_rest(inputs) {}
+
+	// 'head' followed by the inputs of 'rest', which must not have a head
+	InputSpan(const T& head, const InputSpan& rest) : m_head(&head), m_rest(rest.m_rest)
+	{
+		assert(!rest.m_head);
+	}
+
+	// An owned 'head', which must outlive the span
+	InputSpan(T&& head, const InputSpan& rest) : InputSpan(static_cast<const T&>(head), rest)
+	{
+		m_ownedHead = &head;
+	}
+
+	std::size_t size() const { return m_rest.size() + (m_head ? 1 : 0); }
+	const T& front() const { return m_head ? *m_head : m_rest.front(); }
+	// The first input when the span owns it, to be moved from; nullptr otherwise
+	T* ownedFront() const { return m_ownedHead; }
+
+	const T& operator[](std::size_t i) const
+	{
+		if (!m_head) return m_rest[i];
+		return i == 0 ? *m_head : m_rest[i - 1];
+	}
+
+	// The inputs after the first 'offset' ones
+	InputSpan subspan(std::size_t offset) const
+	{
+		if (offset == 0) return *this;
+		return InputSpan(m_rest.subspan(m_head ? offset - 1 : offset));
+	}
+
+private:
+	const T* m_head = nullptr;
+	T* m_ownedHead = nullptr;
+	std::span<const T> m_rest;
+};
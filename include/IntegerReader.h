@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <span>
+#include <string>
+
+// Reads whitespace-separated integers straight out of the buffer of a
+// stream: a token is parsed in place with std::from_chars (or, when it runs
+// past the buffered characters, collected into a small array on the stack),
+// so there is no string, no locale and no stream sentry per value. Only a token the fast path rejects goes through
+// the std::stoi parse of SquareMatrix::checkInteger, so the errors - and
+// odd forms it accepts, like "+5" - are exactly those of reading the
+// tokens one by one with operator>>. The stream is left where operator>>
+// would leave it, with the same eof/fail state.
+class IntegerReader
+{
+public:
+    // Flushes the stream tied to 'istr' (the prompt), like operator>> does
+    explicit IntegerReader(std::istream& istr);
+
+    // Throws std::invalid_argument or std::out_of_range like checkInteger
+    int next();
+    // Reads values.size() integers; each is checked against [low, high] as
+    // soon as it is read, so later tokens are left in the stream on error
+    void read(std::span<int> values, int low, int high);
+
+private:
+    // Longest token parsed on the stack
+    static constexpr std::size_t MAX_TOKEN = 32;
+
+    // next() for a token that is not all in the buffer
+    int nextSplit();
+
+    static bool isSpace(int c);
+    [[noreturn]] static void rangeError();
+    // The per-token parse of checkInteger
+    static int parseSlow(const std::string& token);
+
+    std::istream& m_istr;
+    std::streambuf* m_buffer;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A whole file mapped into memory: an existing file for reading, or a new
+// file of a given size (zero-filled) for writing. Throws FileException when
+// the file cannot be opened, created or mapped.
+class MappedFile
+{
+public:
+    // Maps an existing file for reading
+    explicit MappedFile(const std::string& path);
+    // Creates (or truncates) the file at 'path' with 'size' zero bytes and
+    // maps it for writing
+    MappedFile(const std::string& path, std::size_t size);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::byte* data() { return m_data; }
+    const std::byte* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    void map(const std::string& path, bool writable);
+    void close();
+
+    std::byte* m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
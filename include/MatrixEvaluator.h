@@ -0,0 +1,164 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <utility>
+#include "SquareMatrix.h"
+#include "InputSpan.h"
+#include "OperationVisitor.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "Mul.h"
+#include "Comp.h"
+
+// Evaluates an operation tree on SquareMatrix<T> for an element type T other
+// than the int of Operation::compute, walking the tree with the visitor.
+// Every node is computed like compute() computes it on int: the operands in
+// parallel when they are large, and with the range checks of SquareMatrix<T>.
+// A thread's profiler, if it has one, times every node.
+template <typename T>
+class MatrixEvaluator : public OperationVisitor
+{
+public:
+	using Matrix = SquareMatrix<T>;
+	using Inputs = InputSpan<Matrix>;
+
+	Matrix evaluate(const Operation& operation, Inputs input);
+
+	void visit(const Identity& operation) override;
+	void visit(const Transpose& operation) override;
+	void visit(const Scalar& operation) override;
+	void visit(const Add& operation) override;
+	void visit(const Sub& operation) override;
+	void visit(const Mul& operation) override;
+	void visit(const Comp& operation) override;
+
+private:
+	std::pair<Matrix, Matrix> evaluateOperands(const BinaryOperation& operation);
+
+	// The inputs of the node being visited
+	Inputs m_input = Inputs(std::span<const Matrix>());
+	std::optional<Matrix> m_result;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+typename MatrixEvaluator<T>::Matrix MatrixEvaluator<T>::evaluate(const Operation& operation, Inputs input)
+{
+	m_input = input;
+	if (Profiler* const profiler = Profiler::active())
+	{
+		const Profiler::Scope scope(*profiler, operation);
+		operation.accept(*this);
+	}
+	else operation.accept(*this);
+
+	Matrix result = std::move(*m_result);
+	m_result.reset();
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+// Large operands are computed on two evaluators at once, like computeOperands
+template <typename T>
+std::pair<typename MatrixEvaluator<T>::Matrix, typename MatrixEvaluator<T>::Matrix>
+MatrixEvaluator<T>::evaluateOperands(const BinaryOperation& operation)
+{
+	const Inputs input = m_input;
+	std::optional<Matrix> a, b;
+	const auto computeFirst = [&] { a.emplace(MatrixEvaluator().evaluate(*operation.first(), input)); };
+	const auto computeSecond = [&]
+	{
+		b.emplace(MatrixEvaluator().evaluate(*operation.second(), input.subspan(operation.secondOffset())));
+	};
+
+	const std::size_t size = input.front().size();
+	if (size * size >= PARALLEL_MIN_WORK && !Profiler::active())
+		ThreadPool::instance().join(computeFirst, computeSecond);
+	else
+	{
+		computeFirst();
+		computeSecond();
+	}
+	return { std::move(*a), std::move(*b) };
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixEvaluator<T>::visit(const Identity& operation)
+{
+	(void)operation;
+	if (Matrix* const owned = m_input.ownedFront())
+		m_result.emplace(std::move(*owned));
+	else m_result.emplace(m_input.front());
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixEvaluator<T>::visit(const Transpose& operation)
+{
+	(void)operation;
+	if (Matrix* const owned = m_input.ownedFront())
+		m_result.emplace(std::move(*owned).Transpose());
+	else m_result.emplace(m_input.front().Transpose());
+}
+
+//-----------------------------------------------------------------------------
+
+// The scalar fits an int16 (the Simplifier folds no larger ones), which every
+// element type holds
+template <typename T>
+void MatrixEvaluator<T>::visit(const Scalar& operation)
+{
+	m_result.emplace(m_input.front() * static_cast<T>(operation.scalar()));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixEvaluator<T>::visit(const Add& operation)
+{
+	auto [a, b] = evaluateOperands(operation);
+	a += b;
+	m_result.emplace(std::move(a));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixEvaluator<T>::visit(const Sub& operation)
+{
+	auto [a, b] = evaluateOperands(operation);
+	a -= b;
+	m_result.emplace(std::move(a));
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixEvaluator<T>::visit(const Mul& operation)
+{
+	const auto [a, b] = evaluateOperands(operation);
+	m_result.emplace(a * b);
+}
+
+//-----------------------------------------------------------------------------
+
+// The result of the first operation is the first input of the second one
+template <typename T>
+void MatrixEvaluator<T>::visit(const Comp& operation)
+{
+	const Inputs input = m_input;
+	Matrix resultOfFirst = evaluate(*operation.first(), input);
+	m_result.emplace(evaluate(*operation.second(),
+	                          Inputs(std::move(resultOfFirst), input.subspan(operation.secondOffset()))));
+}
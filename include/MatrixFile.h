@@ -0,0 +1,103 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include "MappedFile.h"
+#include "MatrixView.h"
+
+// Binary matrix file: a 64-byte header followed by the raw matrices, so a
+// batch is read and written through a memory mapping, with nothing parsed
+// or formatted. Every field is little-endian.
+//
+//   offset  size  field
+//        0     8  magic "SQMATRIX"
+//        8     4  version (1)
+//       12     4  element type (1 = 32-bit int)
+//       16     8  size n of the n x n matrices
+//       24     8  stride: elements from one row to the next (>= n)
+//       32     8  count of matrices
+//       40     8  flags (bit 0: a status byte per matrix follows the data)
+//       48    16  reserved, zero
+//       64        count matrices of n rows of 'stride' elements; the
+//                 elements after the first n of a row are zero
+//                 then, with flag bit 0, count status bytes: 1 for a result
+//                 that was out of range (its matrix is all zero)
+//
+// Rows are padded like the rows of SquareMatrix, so with the 64-byte header
+// every matrix and every row of a mapped file starts on a cache line.
+class MatrixFile
+{
+public:
+	// Whether the file at 'path' starts with the magic of a matrix file
+	static bool isMatrixFile(const std::string& path);
+
+	// Maps an existing matrix file for reading; throws FileException unless
+	// it is a valid one
+	explicit MatrixFile(const std::string& path);
+	// Creates a matrix file of 'count' zero size x size matrices and maps it
+	// for writing, with a status per matrix when 'withStatus'
+	MatrixFile(const std::string& path, std::size_t size, std::size_t count, bool withStatus);
+
+	std::size_t size() const { return m_size; }
+	std::size_t count() const { return m_count; }
+	bool hasStatus() const { return m_status != nullptr; }
+
+	MatrixView<const int> matrix(std::size_t i) const;
+	MatrixView<int> matrix(std::size_t i);
+	// Whether matrix i stands for a result that was out of range
+	bool outOfRange(std::size_t i) const;
+	// Threads may mark different matrices at the same time
+	void setOutOfRange(std::size_t i);
+	// The byte size of a file with these matrices
+	static std::size_t fileSize(std::size_t size, std::size_t stride, std::size_t count,
+								bool withStatus);
+
+private:
+	// Points m_data and m_status into the mapping
+	void layout(bool withStatus);
+
+	MappedFile m_file;
+	std::size_t m_size = 0;
+	std::size_t m_stride = 0;
+	std::size_t m_count = 0;
+	int* m_data = nullptr;
+	std::uint8_t* m_status = nullptr;
+};
+
+//-----------------------------------------------------------------------------
+
+// Copies 'source' into 'matrix' (a SquareMatrix or FixedSquareMatrix of the
+// same size), a row at a time
+template <typename Matrix>
+void loadMatrix(MatrixView<const int> source, Matrix& matrix)
+{
+	for (std::size_t i = 0; i < source.rows(); ++i)
+	{
+		const auto row = source.row(i);
+		std::copy(row.begin(), row.end(), &matrix(i, 0));
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename Matrix>
+void storeMatrix(const Matrix& matrix, MatrixView<int> target)
+{
+	for (std::size_t i = 0; i < target.rows(); ++i)
+	{
+		const int* row = &matrix(i, 0);
+		std::copy(row, row + target.cols(), target.row(i).begin());
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Writes the size x size matrices of 'input' (text, as eval reads them) to a
+// new matrix file at 'path'; returns how many there were. Throws
+// std::runtime_error for a malformed matrix, like evalbatch.
+std::size_t writeMatrixFile(std::istream& input, const std::string& path, std::size_t size);
+
+// Writes the matrices of 'file' as text, in the format of evalbatch results
+void writeMatrixText(const MatrixFile& file, std::ostream& output);
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include "MatrixView.h"
+
+// Most text written to a stream at once when a large matrix is written
+const std::size_t FORMAT_BUFFER_BYTES = std::size_t{ 1 } << 20;
+
+// Renders matrices as text with std::to_chars into a character buffer that
+// is reused from matrix to matrix, and writes the buffer to a stream with a
+// single write() - instead of one stream insertion per value and separator.
+// A matrix is rendered like operator<< always did: every value followed by
+// a space and every row by a newline. Floating point values are written in
+// the shortest form that reads back as the same value.
+class MatrixFormatter
+{
+public:
+    // The formatter of the calling thread, for a matrix that is written at once
+    static MatrixFormatter& local();
+
+    MatrixFormatter& append(MatrixView<const int> matrix);
+    MatrixFormatter& append(MatrixView<const std::int16_t> matrix);
+    MatrixFormatter& append(MatrixView<const std::int64_t> matrix);
+    MatrixFormatter& append(MatrixView<const float> matrix);
+    MatrixFormatter& append(MatrixView<const double> matrix);
+    MatrixFormatter& append(std::string_view text);
+    std::string_view text() const { return m_text; }
+
+    // Writes the text, then clears it (keeping the buffer)
+    void flush(std::ostream& ostr);
+    // Appends 'matrix' and flushes - a band of rows at a time, so a large
+    // matrix takes no more than about FORMAT_BUFFER_BYTES of buffer
+    void write(std::ostream& ostr, MatrixView<const int> matrix);
+    void write(std::ostream& ostr, MatrixView<const std::int16_t> matrix);
+    void write(std::ostream& ostr, MatrixView<const std::int64_t> matrix);
+    void write(std::ostream& ostr, MatrixView<const float> matrix);
+    void write(std::ostream& ostr, MatrixView<const double> matrix);
+
+private:
+    template <typename T>
+    MatrixFormatter& appendValues(MatrixView<const T> matrix);
+    template <typename T>
+    void writeBands(std::ostream& ostr, MatrixView<const T> matrix);
+
+    std::string m_text;
+};
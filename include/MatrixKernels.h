@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "MatrixView.h"
+#include "Utility.h"
+
+// Element-wise kernels over raw int buffers used by SquareMatrix<int>.
+// Each kernel does the arithmetic for a whole tile first and only then checks
+// the tile against [low, high] with a vector min/max reduction, so there is
+// no branch inside the inner loop.
+// A kernel returns false as soon as a tile holds a value outside the range
+// (the rest of the destination is then left unspecified). Under the Checked
+// policy a result that overflows an int is outside the range too, whatever
+// the range; Unchecked results wrap.
+// The implementation (SSE2, AVX2 or plain C++) is picked once at runtime.
+namespace MatrixKernels
+{
+    bool add(int* dst, const int* lhs, const int* rhs, std::size_t count,
+             int low, int high, RangePolicy policy);
+    bool sub(int* dst, const int* lhs, const int* rhs, std::size_t count,
+             int low, int high, RangePolicy policy);
+    bool scale(int* dst, const int* src, int scalar, std::size_t count,
+               int low, int high, RangePolicy policy);
+
+    // c = a * b with the cache-tiled kernel from GemmKernel.h, compiled for
+    // the selected instruction set; the range is checked once per output tile
+    bool gemm(MatrixView<const int> a, MatrixView<const int> b, MatrixView<int> c,
+              std::int64_t low, std::int64_t high, RangePolicy policy);
+
+    // Name of the selected implementation ("avx2", "sse2" or "scalar")
+    const char* isaName();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include "AlignedAllocator.h"
+
+// A memory resource that keeps the blocks given back to it and hands them
+// out again. Blocks are kept in buckets by size class - four classes per
+// power of two, so a block is at most a quarter larger than asked for - and
+// are MATRIX_ALIGNMENT aligned. Once an evaluation of some shape has run,
+// the next one like it is served from the buckets without calling the
+// upstream resource at all.
+// One thread at a time may use a pool.
+class MatrixPool : public std::pmr::memory_resource
+{
+public:
+    explicit MatrixPool(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+    ~MatrixPool() override;
+    MatrixPool(const MatrixPool&) = delete;
+    MatrixPool& operator=(const MatrixPool&) = delete;
+
+    // Returns the kept blocks to the upstream resource
+    void release();
+
+private:
+    // A kept block links to the next block of its bucket
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    // Blocks of up to 2^MAX_POOLED_WIDTH bytes are pooled
+    static constexpr unsigned MAX_POOLED_WIDTH = 48;
+    static constexpr std::size_t MIN_BLOCK = MATRIX_ALIGNMENT;
+    static constexpr std::size_t BUCKET_COUNT = 4 * (MAX_POOLED_WIDTH - 6) + 1;
+
+    // The bucket of a 'bytes' request, or BUCKET_COUNT when it is not pooled
+    static std::size_t bucketOf(std::size_t bytes, std::size_t alignment);
+    static std::size_t blockSize(std::size_t bucket);
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource* m_upstream;
+    std::array<FreeBlock*, BUCKET_COUNT> m_buckets{};
+};
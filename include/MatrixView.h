@@ -0,0 +1,46 @@
+#pragma once
+#include <span>
+#include <cstddef>
+
+// Non-owning view over a rectangular block of a row-major matrix buffer.
+// T may be const-qualified for read-only views.
+// Rows are 'stride' elements apart, so kernels can walk each row linearly.
+template <typename T>
+class MatrixView
+{
+public:
+	MatrixView(T* data, std::size_t rows, std::size_t cols, std::size_t stride)
+		: m_data(data), m_rows(rows), m_cols(cols), m_stride(stride) {}
+
+	std::size_t rows() const { return m_rows; }
+	std::size_t cols() const { return m_cols; }
+	std::size_t stride() const { return m_stride; }
+	T* data() const { return m_data; }
+
+	T& operator()(std::size_t i, std::size_t j) const { return m_data[i * m_stride + j]; }
+	std::span<T> row(std::size_t i) const;
+	MatrixView subview(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols) const;
+
+private:
+	T* m_data;
+	std::size_t m_rows;
+	std::size_t m_cols;
+	std::size_t m_stride;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+std::span<T> MatrixView<T>::row(std::size_t i) const
+{
+	return std::span<T>(m_data + i * m_stride, m_cols);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixView<T> MatrixView<T>::subview(std::size_t row, std::size_t col,
+                                     std::size_t rows, std::size_t cols) const
+{
+	return MatrixView(m_data + row * m_stride + col, rows, cols, m_stride);
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// What a counted allocation holds
+enum class MemoryKind
+{
+    Matrix,    // the buffer of a SquareMatrix
+    Operation, // an operation node (with its shared_ptr control block)
+};
+
+// Counters of the memory held by matrices and by operation nodes, for the
+// stats command. The totals are of the whole process (every session); the
+// peak is of the matrices allocated by the calling thread inside a
+// PeakScope. Allocators call allocated() and deallocated().
+class MemoryStats
+{
+public:
+    struct Totals
+    {
+        std::size_t liveBytes = 0;
+        std::size_t allocations = 0;
+        std::size_t deallocations = 0;
+    };
+
+    // Measures the highest number of matrix bytes the calling thread holds
+    // on top of what it held when the scope began; stores it in 'peakBytes'
+    // when the scope ends
+    class PeakScope
+    {
+    public:
+        explicit PeakScope(std::size_t& peakBytes);
+        ~PeakScope();
+        PeakScope(const PeakScope&) = delete;
+        PeakScope& operator=(const PeakScope&) = delete;
+
+    private:
+        std::size_t& m_peakBytes;
+        std::int64_t m_base;
+        std::int64_t m_outerPeak;
+    };
+
+    static void allocated(MemoryKind kind, std::size_t bytes)
+    {
+        Counters& counters = s_counters[static_cast<std::size_t>(kind)];
+        counters.allocations.fetch_add(1, std::memory_order_relaxed);
+        counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (kind == MemoryKind::Matrix)
+        {
+            t_allocatedMatrixBytes += bytes;
+            t_matrixBytes += static_cast<std::int64_t>(bytes);
+            t_peakMatrixBytes = std::max(t_peakMatrixBytes, t_matrixBytes);
+        }
+    }
+
+    static void deallocated(MemoryKind kind, std::size_t bytes)
+    {
+        Counters& counters = s_counters[static_cast<std::size_t>(kind)];
+        counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+        counters.liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (kind == MemoryKind::Matrix)
+            t_matrixBytes -= static_cast<std::int64_t>(bytes);
+    }
+
+    static Totals totals(MemoryKind kind);
+
+    // Matrix bytes the calling thread has allocated so far, freed or not
+    static std::size_t allocatedByThread() { return t_allocatedMatrixBytes; }
+
+private:
+    struct Counters
+    {
+        std::atomic<std::size_t> liveBytes;
+        std::atomic<std::size_t> allocations;
+        std::atomic<std::size_t> deallocations;
+    };
+
+    static inline std::array<Counters, 2> s_counters{};
+    // Matrix bytes allocated less those freed by this thread - negative when
+    // it frees matrices another thread allocated
+    static inline thread_local std::int64_t t_matrixBytes = 0;
+    static inline thread_local std::int64_t t_peakMatrixBytes = 0;
+    static inline thread_local std::size_t t_allocatedMatrixBytes = 0;
+};
+
+// std::allocator that counts what it allocates as MemoryKind::Operation.
+// Given to std::allocate_shared, it counts the control block too.
+template <typename T>
+class NodeAllocator
+{
+public:
+    using value_type = T;
+
+    NodeAllocator() = default;
+    template <typename U>
+    NodeAllocator(const NodeAllocator<U>&) {}
+
+    T* allocate(std::size_t count)
+    {
+        T* const ptr = std::allocator<T>().allocate(count);
+        MemoryStats::allocated(MemoryKind::Operation, count * sizeof(T));
+        return ptr;
+    }
+
+    void deallocate(T* ptr, std::size_t count)
+    {
+        MemoryStats::deallocated(MemoryKind::Operation, count * sizeof(T));
+        std::allocator<T>().deallocate(ptr, count);
+    }
+
+    template <typename U>
+    bool operator==(const NodeAllocator<U>&) const { return true; }
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "BinaryOperation.h"
+
+#include <memory>
+
+
+// Represents the matrix product of the results of two operations
+class Mul : public BinaryOperation
+{
+public:
+    using BinaryOperation::BinaryOperation;
+    T compute(Inputs input) const override;
+    void accept(OperationVisitor& visitor) const override;
+    void printSymbol(std::ostream& ostr) const override;
+};
@@ -1,7 +1,14 @@
 #pragma once
 
 #include "SquareMatrix.h"
-
+#include "InputSpan.h"
+#include "OperationVisitor.h"
+#include "Profiler.h"
+#include "MemoryStats.h"
+
+#include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 #include <iosfwd>
 
@@ -11,16 +18,39 @@ class Operation
 {
 public:
     using T = SquareMatrix<int>;
+    using Inputs = InputSpan<T>;
     virtual ~Operation() = default;
 
     // Return the number of inputs (the range size) expected by compute()
     virtual int inputCount() const = 0;
 
-    // Computes the resulted set
-    virtual T compute(const std::vector<T>& input) const =0;
+    // Computes the resulted set from the first inputCount() inputs
+    virtual T compute(Inputs input) const =0;
+
+    // compute(), timed by the thread's profiler if there is one; the
+    // operations compute their operands with it
+    T evaluate(Inputs input) const
+    {
+        Profiler* const profiler = Profiler::active();
+        if (!profiler) [[likely]]
+            return compute(input);
+
+        const Profiler::Scope scope(*profiler, *this);
+        return compute(input);
+    }
+
+    // Calls the visitor's visit() overload for the concrete operation type
+    virtual void accept(OperationVisitor& visitor) const = 0;
 
     // Prints the operation with generic name for the sets or with the actual input arguments
     virtual void print(std::ostream& ostr, bool first_print = false) const = 0;
 
-    virtual void print(std::ostream& ostr, const std::vector<T>& input) const;
+    virtual void print(std::ostream& ostr, std::span<const T> input) const;
 };
+
+// Creates an operation whose node is counted by MemoryStats
+template <typename Op, typename... Args>
+std::shared_ptr<Op> makeOperation(Args&&... args)
+{
+    return std::allocate_shared<Op>(NodeAllocator<Op>(), std::forward<Args>(args)...);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Operation;
+
+// The operations of a calculator, shared by all of its sessions and
+// published as immutable snapshots. A session takes the current snapshot
+// with one atomic load and uses it, without any lock, for as long as it
+// likes - a snapshot never changes. A change is made to a copy of the latest
+// snapshot, which then replaces it. Changes are serialized among themselves,
+// so none is lost, but they never wait for a reader.
+class OperationRegistry
+{
+public:
+    using OperationList = std::vector<std::shared_ptr<Operation>>;
+
+    struct Snapshot
+    {
+        OperationList operations;
+        // The operations as they are evaluated: operations[i] rewritten by
+        // the Simplifier, and printed as operations[i]
+        OperationList evaluated;
+        // The limit on the number of operations; 0 until one is chosen
+        int maxOperations = 0;
+        // The number of changes committed before this snapshot
+        std::uint64_t version = 0;
+    };
+
+    // The memory a snapshot holds
+    struct Usage
+    {
+        std::size_t uniqueNodes = 0;
+        // Nodes reached from more than one place: from two parents, or from
+        // a parent and the operation list
+        std::size_t sharedNodes = 0;
+        // Of the nodes (without their control blocks) and of the lists
+        std::size_t bytes = 0;
+    };
+
+    // Starts with the built-in operations and the given limit (0 = none
+    // chosen yet)
+    explicit OperationRegistry(int maxOperations = 0);
+
+    std::shared_ptr<const Snapshot> current() const;
+
+    static Usage usage(const Snapshot& snapshot);
+
+    // Publishes the latest snapshot as changed by change(Snapshot&), and
+    // returns it. When change() throws, nothing is published.
+    template <typename Change>
+    std::shared_ptr<const Snapshot> commit(Change change);
+
+private:
+    std::atomic<std::shared_ptr<const Snapshot>> m_current;
+    std::mutex m_commitMutex;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename Change>
+std::shared_ptr<const OperationRegistry::Snapshot> OperationRegistry::commit(Change change)
+{
+    std::lock_guard lock(m_commitMutex);
+    auto next = std::make_shared<Snapshot>(*m_current.load());
+    change(*next);
+    ++next->version;
+
+    std::shared_ptr<const Snapshot> published = std::move(next);
+    m_current.store(published);
+    return published;
+}
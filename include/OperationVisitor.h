@@ -0,0 +1,25 @@
+#pragma once
+
+class Identity;
+class Transpose;
+class Scalar;
+class Add;
+class Sub;
+class Mul;
+class Comp;
+
+// Double dispatch over the concrete operation types, for evaluators that
+// walk an operation tree instead of calling Operation::compute
+class OperationVisitor
+{
+public:
+    virtual ~OperationVisitor() = default;
+
+    virtual void visit(const Identity& operation) = 0;
+    virtual void visit(const Transpose& operation) = 0;
+    virtual void visit(const Scalar& operation) = 0;
+    virtual void visit(const Add& operation) = 0;
+    virtual void visit(const Sub& operation) = 0;
+    virtual void visit(const Mul& operation) = 0;
+    virtual void visit(const Comp& operation) = 0;
+};
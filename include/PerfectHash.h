@@ -0,0 +1,78 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+// Perfect hash over a fixed set of keys, built at compile time: a seed is
+// searched for under which every key hashes (FNV-1a) to a slot of its own,
+// so a lookup is one hash, one slot and one comparison.
+template <std::size_t Count>
+class PerfectHash
+{
+public:
+	consteval explicit PerfectHash(const std::array<std::string_view, Count>& keys);
+
+	// The index of 'key' among the keys, or Count when it is not one of them
+	constexpr std::size_t find(std::string_view key) const;
+
+private:
+	static constexpr std::size_t TABLE_SIZE = std::bit_ceil(Count * 2);
+	// Seeds tried before giving up (a compile error)
+	static constexpr std::uint32_t MAX_SEED = 1 << 16;
+
+	static constexpr std::size_t slot(std::string_view key, std::uint32_t seed);
+
+	std::array<std::string_view, Count> m_keys;
+	std::uint32_t m_seed = 0;
+	// Key index per slot; Count for an empty slot
+	std::array<std::size_t, TABLE_SIZE> m_slots{};
+};
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t Count>
+constexpr std::size_t PerfectHash<Count>::slot(std::string_view key, std::uint32_t seed)
+{
+	std::uint32_t hash = 2166136261u ^ seed;
+	for (const char c : key)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	// The low bits of an FNV-1a hash only depend on the low bits of the seed
+	return (hash ^ (hash >> 16)) & (TABLE_SIZE - 1);
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t Count>
+consteval PerfectHash<Count>::PerfectHash(const std::array<std::string_view, Count>& keys)
+	: m_keys(keys)
+{
+	for (; m_seed < MAX_SEED; ++m_seed)
+	{
+		m_slots.fill(Count);
+		bool perfect = true;
+		for (std::size_t i = 0; i < Count && perfect; ++i)
+		{
+			std::size_t& entry = m_slots[slot(keys[i], m_seed)];
+			perfect = entry == Count;
+			entry = i;
+		}
+		if (perfect)
+			return;
+	}
+	throw std::logic_error("no perfect hash seed for these keys");
+}
+
+//-----------------------------------------------------------------------------
+
+template <std::size_t Count>
+constexpr std::size_t PerfectHash<Count>::find(std::string_view key) const
+{
+	const std::size_t index = m_slots[slot(key, m_seed)];
+	return index != Count && m_keys[index] == key ? index : Count;
+}
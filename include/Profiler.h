@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+class Operation;
+
+// Per-node counters of the evaluations run on one thread while a profiler
+// exists: how many times each node of the operation tree was computed, the
+// time spent in it (with and without its children) and the bytes of the
+// matrices it allocated itself.
+// While a profiler is active the nodes are computed one at a time - no
+// fusion and no parallel operands - so that the cost of each is its own.
+// Without one, the only cost is a thread-local test per computed node.
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct NodeStats
+    {
+        std::size_t calls = 0;
+        Clock::duration inclusive{};
+        Clock::duration exclusive{};
+        std::size_t bytes = 0; // allocated by the node, not by its children
+    };
+
+    // Times one computation of a node, from construction to destruction
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, const Operation& node);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& m_profiler;
+    };
+
+    // The profiler of the calling thread, until it is destroyed
+    Profiler();
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // The profiler of the calling thread, or nullptr
+    static Profiler* active() { return s_active; }
+
+    // 'root' as an indented tree, a node per line with its counters
+    void print(std::ostream& ostr, const Operation& root) const;
+
+private:
+    // A node being computed
+    struct Frame
+    {
+        const Operation* node;
+        Clock::time_point start;
+        Clock::duration children{};
+        std::size_t allocatedAtStart = 0;
+        std::size_t childBytes = 0;
+    };
+
+    void printNode(std::ostream& ostr, const Operation& node, int depth,
+                   std::vector<const Operation*>& printed) const;
+
+    std::unordered_map<const Operation*, NodeStats> m_nodes;
+    std::vector<Frame> m_frames;
+    Profiler* m_previous;
+
+    static inline thread_local Profiler* s_active = nullptr;
+};
@@ -1,20 +1,58 @@
 #pragma once
-#include <fstream>
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <spanstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "utility.h"
+#include "MappedFile.h"
 
 class FunctionCalculator;
 
+// Runs the commands of a script file. The file is mapped and split into
+// lines once; every non-blank line is a command.
+// With ScriptPolicy::Ask a failed command asks on std::cin whether to go on.
+// Any other policy runs unattended: std::cin is never read, and the input
+// stream of the calculator reads the script itself, so eval takes its
+// matrices from the lines after the command.
 class Read
 {
 public:
-	Read(FunctionCalculator* funcPtr, std::string pathName);
-	~Read();
-	void readFile();
+	Read(FunctionCalculator* funcPtr, std::string pathName, std::istream& input,
+	     std::ostream& output, ScriptPolicy policy);
+	// Runs the script and reports how long it took; returns false when it
+	// was stopped before its end
+	bool readFile();
 
 private:
+	struct Failure
+	{
+		std::size_t line;
+		std::string command;
+		std::string message;
+	};
+
+	// Handles a failed command; returns whether to go on
+	bool handleFailure(const Failure& failure);
+	void printFailure(const Failure& failure) const;
+	void printReport(std::size_t commands, std::chrono::steady_clock::duration time,
+	                 bool completed) const;
+	// The line that holds the text at 'position'
+	std::size_t lineAt(std::size_t position) const;
+
 	FunctionCalculator* m_funcPtr;
-	std::ifstream m_inputFile;
+	std::string m_pathName;
+	std::istream& m_input;
+	std::ostream& m_output;
+	ScriptPolicy m_policy;
+	MappedFile m_file;
+	std::string_view m_text;
+	// The lines of m_text, without their line breaks
+	std::vector<std::string_view> m_lines;
+	std::vector<Failure> m_failures;
 
 	void printException(std::string message, std::string lineCommand);
-};
\ No newline at end of file
+};
@@ -9,7 +9,9 @@ class Scalar : public UnaryOperation
 {
 public:
     Scalar(int scalar);
-    T compute(const std::vector<T>& input) const override;
+    int scalar() const { return m_scalar; }
+    T compute(Inputs input) const override;
+    void accept(OperationVisitor& visitor) const override;
     void print(std::ostream& ostr, bool first_print = false) const override;
 
 private:
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "CalculatorOptions.h"
+#include "OperationRegistry.h"
+#include "SocketBuffer.h"
+
+// Serves calculator sessions on a Unix domain socket. Every client that
+// connects gets a session of its own: a FunctionCalculator, on a thread of
+// its own, that reads the client's commands and writes back what the
+// console would show. The sessions share one OperationRegistry - an
+// operation one client defines is there for all of them - and evaluate
+// without any lock, so independent sessions run on as many cores as there
+// are sessions.
+// Scripts run by a session never ask what to do about a failed command
+// (there is no console to ask on): with --script-errors ask they collect
+// the failures instead.
+class Server
+{
+public:
+    Server(std::string path, const CalculatorOptions& options);
+    // Stops listening and removes the socket; sessions that are still
+    // connected go on until the process ends
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Listens and starts a session for every client, until accepting fails.
+    // Throws std::runtime_error when the socket cannot be set up or accept
+    // fails.
+    void run();
+
+private:
+    void listen();
+    void startSession(SocketHandle client);
+
+    std::string m_path;
+    CalculatorOptions m_options;
+    std::shared_ptr<OperationRegistry> m_registry;
+    bool m_listening = false;
+    SocketHandle m_listener = 0;
+    std::size_t m_sessions = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Operation.h"
+#include "Utility.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+// Rewrites a newly defined operation, whose operands are already simplified,
+// into a cheaper one with the same results and the same range errors:
+//  - a chain of unary operations (tran, scal, iden and their comps) keeps
+//    its scalars in order and ends with at most one transpose, so tran->tran
+//    cancels out and a comp with iden disappears;
+//  - scal a -> scal b is folded into scal a*b when the intermediate a*x
+//    cannot be out of range unless a*b*x is too (b >= 1), and a*b*x cannot
+//    overflow; scal 1 is removed and nothing after scal 0 is kept;
+//  - comp f (u) where f ends with a unary chain merges the two chains.
+// Without range checks the values wrap, so every scalar chain is folded and
+// a scalar applied to both operands of add/sub is factored out of them.
+// With range checks such a factoring could hide an error (a*x + a*y may be
+// in range while a*x is not), so it is not done.
+// Shared nodes are walked once, and a rewrite that would make the graph
+// bigger (a chain of shared chains spelled out) keeps the original.
+class Simplifier
+{
+public:
+    explicit Simplifier(RangePolicy policy) : m_policy(policy) {}
+
+    std::shared_ptr<Operation> simplify(const std::shared_ptr<Operation>& operation) const;
+
+private:
+    class Chain;
+
+    std::optional<Chain> chainOf(const Operation& operation, std::size_t maxNodes) const;
+    std::shared_ptr<Operation> simplifyComp(const std::shared_ptr<Operation>& operation) const;
+    std::shared_ptr<Operation> factorScalar(const std::shared_ptr<Operation>& operation) const;
+
+    RangePolicy m_policy;
+};
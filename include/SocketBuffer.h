@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+#ifdef _WIN32
+using SocketHandle = std::uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+
+void closeSocket(SocketHandle socket);
+
+// A stream buffer over a connected socket, which it closes when it is
+// destroyed. What was written is sent before the buffer waits for input, so
+// a prompt always reaches the client before its answer is read. The end of
+// the input (the client went away) is the end of the stream, and a failed
+// send fails the stream.
+class SocketBuffer : public std::streambuf
+{
+public:
+    explicit SocketBuffer(SocketHandle socket);
+    ~SocketBuffer() override;
+    SocketBuffer(const SocketBuffer&) = delete;
+    SocketBuffer& operator=(const SocketBuffer&) = delete;
+
+protected:
+    int_type underflow() override;
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+private:
+    // Sends the put area; returns whether all of it was sent
+    bool flush();
+
+    static constexpr std::size_t BUFFER_BYTES = std::size_t{ 1 } << 16;
+
+    SocketHandle m_socket;
+    std::vector<char> m_input;
+    std::vector<char> m_output;
+};
@@ -3,43 +3,144 @@
 #include <iostream>
 #include <cmath>
 #include <string>
+#include <span>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <charconv>
+#include <utility>
 #include "Utility.h"
+#include "MatrixKernels.h"
+#include "ElementKernels.h"
+#include "AlignedAllocator.h"
+#include "MatrixView.h"
+#include "TransposeKernel.h"
+#include "GemmKernel.h"
+#include "ThreadPool.h"
+#include "IntegerReader.h"
+#include "MatrixFormatter.h"
+
+// Square matrix stored in one contiguous, row-major, 64-byte aligned buffer.
+// Every row starts on a cache line: rows are 'stride()' elements apart and
+// the padding at the end of each row is kept zero.
+// Element-wise operators run over the whole buffer (padding included) and
+// check the allowed value range once per tile, not once per element.
+// Sizes and indices are 64-bit, so a matrix may hold more than 2^31 elements.
+// The range checks follow a per-element-type policy and range (see
+// setRangePolicy and setAllowedRange). int runs on the SIMD kernels of
+// MatrixKernels, the other element types on those of ElementKernels.
+// The buffer comes from a std::pmr::memory_resource, given like to any
+// allocator-aware type (a std::pmr container passes its own on); a copy made
+// without one uses the default resource, so it may outlive the original's.
+static_assert(MIN_ALLOWED_VALUE <= 0 && 0 <= MAX_ALLOWED_VALUE,
+	"the zero padding of a matrix row must be an allowed value");
+
+// The allowed range of an element type until one is set: int keeps
+// [MIN_ALLOWED_VALUE, MAX_ALLOWED_VALUE]; int16 and int64 allow every value,
+// float and double every finite one. A checked result that overflows the
+// type is out of range whatever the range (the kernels detect it).
+template <typename T>
+constexpr std::pair<T, T> defaultAllowedRange()
+{
+	if constexpr (std::is_same_v<T, int>)
+		return { MIN_ALLOWED_VALUE, MAX_ALLOWED_VALUE };
+	else
+		return { std::numeric_limits<T>::lowest(), std::numeric_limits<T>::max() };
+}
 
 template <typename T>
 class SquareMatrix
 {
 public:
+	using allocator_type = AlignedAllocator<T, MATRIX_ALIGNMENT>;
+	using Buffer = std::vector<T, allocator_type>;
+
+	// Tag for a matrix whose elements are about to be overwritten:
+	// only the row padding is initialized
+	struct Uninitialized {};
+
 	SquareMatrix(const SquareMatrix&) = default;
 	SquareMatrix(SquareMatrix&&) = default;
 	SquareMatrix& operator=(const SquareMatrix&) = default;
 	SquareMatrix& operator=(SquareMatrix&&) = default;
 	~SquareMatrix() = default;
-	SquareMatrix(int size, const T& value);
-	SquareMatrix(int size);
-
-	void checkValidValue(int value) const;
-	int checkInteger(std::istream& istr) const;
-	int size() const;
-
-	T& operator()(int i, int j);
-	const T& operator()(int i, int j) const;
+	SquareMatrix(const SquareMatrix& other, const allocator_type& allocator);
+	SquareMatrix(SquareMatrix&& other, const allocator_type& allocator);
+	SquareMatrix(std::size_t size, const T& value, const allocator_type& allocator = {});
+	explicit SquareMatrix(std::size_t size);
+	SquareMatrix(std::size_t size, Uninitialized, const allocator_type& allocator = {});
+
+	allocator_type get_allocator() const;
+
+	// Checked (the default) throws std::out_of_range for values outside
+	// the allowed range, or that overflow T; Unchecked lets them wrap
+	static void setRangePolicy(RangePolicy policy);
+	static RangePolicy rangePolicy();
+	// The allowed range of the element type, defaultAllowedRange<T>()
+	// unless set; it must hold 0 (the row padding)
+	static void setAllowedRange(T low, T high);
+
+	// Bounds handed to the kernels: the allowed range, or the whole
+	// representable range when the policy is Unchecked
+	template <typename Bound>
+	static Bound lowBound();
+	template <typename Bound>
+	static Bound highBound();
+	[[noreturn]] static void rangeError();
+	// Row length, in elements, of a size x size matrix
+	static std::size_t paddedStride(std::size_t size);
+
+	static void checkValidValue(T value);
+	void checkValidRange() const;
+	static int checkInteger(std::istream& istr);
+	std::size_t size() const;
+	std::size_t stride() const;
+
+	T* data();
+	const T* data() const;
+	std::span<T> row(std::size_t i);
+	std::span<const T> row(std::size_t i) const;
+	MatrixView<T> view();
+	MatrixView<const T> view() const;
+	MatrixView<T> subview(std::size_t row, std::size_t col, std::size_t rows, std::size_t cols);
+	MatrixView<const T> subview(std::size_t row, std::size_t col,
+	                            std::size_t rows, std::size_t cols) const;
+
+	T& operator()(std::size_t i, std::size_t j);
+	const T& operator()(std::size_t i, std::size_t j) const;
 	SquareMatrix& operator+=(const SquareMatrix& rhs);
 	SquareMatrix& operator-=(const SquareMatrix& rhs);
 	SquareMatrix operator+(const SquareMatrix& rhs) const;
 	SquareMatrix operator-(const SquareMatrix& rhs) const;
 	SquareMatrix operator*(const T& scalar) const;
-	SquareMatrix Transpose() const;
+	SquareMatrix operator*(const SquareMatrix& rhs) const;
+	// *this = lhs * rhs in the existing buffer (of the same size, and not
+	// the buffer of lhs or rhs)
+	void assignProduct(const SquareMatrix& lhs, const SquareMatrix& rhs);
+	SquareMatrix Transpose() const&;
+	SquareMatrix Transpose() &&;
+	void transposeInPlace();
 
 private:
-	int m_size;
-	std::vector<std::vector<T>> m_matrix;
+	void clearPadding();
+
+	inline static RangePolicy s_rangePolicy = RangePolicy::Checked;
+	inline static T s_low = defaultAllowedRange<T>().first;
+	inline static T s_high = defaultAllowedRange<T>().second;
+
+	std::size_t m_size;
+	std::size_t m_stride;
+	Buffer m_matrix;
 
 };
 
 //-----------------------------------------------------------------------------
 
 template <typename T>
-int SquareMatrix<T>::size() const
+std::size_t SquareMatrix<T>::size() const
 {
 	return m_size;
 }
@@ -47,77 +148,250 @@ int SquareMatrix<T>::size() const
 //-----------------------------------------------------------------------------
 
 template <typename T>
-void SquareMatrix<T>::checkValidValue(int value) const
+std::size_t SquareMatrix<T>::stride() const
 {
-	if (value > MAX_ALLOWED_VALUE || value < MIN_ALLOWED_VALUE)
-	{
-		throw std::out_of_range("Value is out of the allowed range!");
-	}
+	return m_stride;
+}
+
+//-----------------------------------------------------------------------------
+
+// Rounds the row length up to a whole number of cache lines
+template <typename T>
+std::size_t SquareMatrix<T>::paddedStride(std::size_t size)
+{
+	const std::size_t perLine = MATRIX_ALIGNMENT / sizeof(T);
+	if (perLine <= 1) return size;
+	return (size + perLine - 1) / perLine * perLine;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void SquareMatrix<T>::rangeError()
+{
+	throw std::out_of_range(RANGE_ERROR_MESSAGE);
 }
 
 //-----------------------------------------------------------------------------
 
 template <typename T>
-int SquareMatrix<T>::checkInteger(std::istream& istr) const
+void SquareMatrix<T>::setRangePolicy(RangePolicy policy)
 {
-	std::string input;
-	std::size_t pos;
+	s_rangePolicy = policy;
+}
 
-	istr >> input;
-	int value = std::stoi(input, &pos);
+//-----------------------------------------------------------------------------
 
-	if (pos != input.size())
+template <typename T>
+RangePolicy SquareMatrix<T>::rangePolicy()
+{
+	return s_rangePolicy;
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void SquareMatrix<T>::setAllowedRange(T low, T high)
+{
+	if (!(low <= T{} && T{} <= high))
 	{
-		throw std::out_of_range("Input is not a valid number.");
+		throw std::invalid_argument("The allowed range must hold 0.");
 	}
-	return value;
+	s_low = low;
+	s_high = high;
 }
 
 //-----------------------------------------------------------------------------
 
+// Unchecked floating point values may reach the infinities
 template <typename T>
-const T& SquareMatrix<T>::operator()(int i, int j) const
+template <typename Bound>
+Bound SquareMatrix<T>::lowBound()
 {
-	return m_matrix[i][j];
+	if (s_rangePolicy == RangePolicy::Checked) return static_cast<Bound>(s_low);
+	if constexpr (std::numeric_limits<Bound>::has_infinity) return -std::numeric_limits<Bound>::infinity();
+	else return std::numeric_limits<Bound>::lowest();
 }
 
 //-----------------------------------------------------------------------------
 
 template <typename T>
-T& SquareMatrix<T>::operator()(int i, int j)
+template <typename Bound>
+Bound SquareMatrix<T>::highBound()
 {
-	return m_matrix[i][j];
+	if (s_rangePolicy == RangePolicy::Checked) return static_cast<Bound>(s_high);
+	if constexpr (std::numeric_limits<Bound>::has_infinity) return std::numeric_limits<Bound>::infinity();
+	else return std::numeric_limits<Bound>::max();
 }
 
 //-----------------------------------------------------------------------------
 
-inline std::ostream& operator<<(std::ostream& ostr, const SquareMatrix<int>& matrix)
+// Written so that a NaN is out of range
+template <typename T>
+void SquareMatrix<T>::checkValidValue(T value)
 {
-	for (int i = 0; i < matrix.size(); ++i)
+	if (s_rangePolicy == RangePolicy::Unchecked) return;
+
+	if (!(value >= s_low && value <= s_high))
 	{
-		for (int j = 0; j < matrix.size(); ++j)
-		{
-			ostr << matrix(i, j) << ' ';
-		}
-		ostr << '\n';
+		rangeError();
 	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Checks every element with one min/max reduction over the buffer
+template <typename T>
+void SquareMatrix<T>::checkValidRange() const
+{
+	if (m_matrix.empty() || s_rangePolicy == RangePolicy::Unchecked) return;
+
+	const auto [minValue, maxValue] = std::ranges::minmax(m_matrix);
+	if (minValue < s_low || maxValue > s_high)
+	{
+		rangeError();
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+int SquareMatrix<T>::checkInteger(std::istream& istr)
+{
+	return IntegerReader(istr).next();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+T* SquareMatrix<T>::data()
+{
+	return m_matrix.data();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+const T* SquareMatrix<T>::data() const
+{
+	return m_matrix.data();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+std::span<T> SquareMatrix<T>::row(std::size_t i)
+{
+	return view().row(i);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+std::span<const T> SquareMatrix<T>::row(std::size_t i) const
+{
+	return view().row(i);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixView<T> SquareMatrix<T>::view()
+{
+	return MatrixView<T>(data(), m_size, m_size, m_stride);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixView<const T> SquareMatrix<T>::view() const
+{
+	return MatrixView<const T>(data(), m_size, m_size, m_stride);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixView<T> SquareMatrix<T>::subview(std::size_t row, std::size_t col,
+                                       std::size_t rows, std::size_t cols)
+{
+	return view().subview(row, col, rows, cols);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixView<const T> SquareMatrix<T>::subview(std::size_t row, std::size_t col,
+                                             std::size_t rows, std::size_t cols) const
+{
+	return view().subview(row, col, rows, cols);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+const T& SquareMatrix<T>::operator()(std::size_t i, std::size_t j) const
+{
+	return m_matrix[i * m_stride + j];
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+T& SquareMatrix<T>::operator()(std::size_t i, std::size_t j)
+{
+	return m_matrix[i * m_stride + j];
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+std::ostream& operator<<(std::ostream& ostr, const SquareMatrix<T>& matrix)
+{
+	MatrixFormatter::local().write(ostr, matrix.view());
 	return ostr;
 }
 
 //-----------------------------------------------------------------------------
 
+// Every value is checked as soon as it is read, like checkInteger followed
+// by checkValidValue
 inline std::istream& operator>>(std::istream& istr, SquareMatrix<int>& matrix)
 {
-	int input;
+	IntegerReader reader(istr);
 
-	for (int i = 0; i < matrix.size(); ++i)
+	for (std::size_t i = 0; i < matrix.size(); ++i)
 	{
-		for (int j = 0; j < matrix.size(); ++j)
-		{
-			input = matrix.checkInteger(istr);
-			matrix.checkValidValue(input);
+		reader.read(matrix.row(i), SquareMatrix<int>::lowBound<int>(), SquareMatrix<int>::highBound<int>());
+	}
+
+	return istr;
+}
 
-			matrix(i, j) = input;
+//-----------------------------------------------------------------------------
+
+// The other element types are read a token at a time and parsed with
+// std::from_chars; every value is checked as soon as it is read, and the
+// errors are those of the int reader
+template <typename T>
+std::istream& operator>>(std::istream& istr, SquareMatrix<T>& matrix)
+{
+	std::string token;
+	for (std::size_t i = 0; i < matrix.size(); ++i)
+	{
+		for (T& element : matrix.row(i))
+		{
+			if (!(istr >> token)) return istr;
+
+			const char* end = token.data() + token.size();
+			const auto [parsed, error] = std::from_chars(token.data(), end, element);
+			if (error == std::errc::result_out_of_range)
+				SquareMatrix<T>::rangeError();
+			if (error != std::errc())
+				throw std::invalid_argument("Input is not a valid number.");
+			if (parsed != end)
+				throw std::out_of_range("Input is not a valid number.");
+			SquareMatrix<T>::checkValidValue(element);
 		}
 	}
 
@@ -129,24 +403,76 @@ inline std::istream& operator>>(std::istream& istr, SquareMatrix<int>& matrix)
 // Implementation must be in .h file for the compiler to see it and instantiate
 // the relevant function
 template <typename T>
-SquareMatrix<T>::SquareMatrix(int size, const T& value)
-	: m_size(size), m_matrix(size, std::vector<T>(size, value))
+SquareMatrix<T>::SquareMatrix(const SquareMatrix& other, const allocator_type& allocator)
+	: m_size(other.m_size), m_stride(other.m_stride), m_matrix(other.m_matrix, allocator)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+SquareMatrix<T>::SquareMatrix(SquareMatrix&& other, const allocator_type& allocator)
+	: m_size(other.m_size), m_stride(other.m_stride), m_matrix(std::move(other.m_matrix), allocator)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+SquareMatrix<T>::SquareMatrix(std::size_t size, const T& value, const allocator_type& allocator)
+	: SquareMatrix(size, Uninitialized{}, allocator)
 {
-	for (int i = 0; i < size * size; ++i)
+	for (std::size_t i = 0; i < size; ++i)
 	{
-		m_matrix[i / size][i % size] = value;
+		for (T& element : row(i))
+		{
+			element = value;
+		}
 	}
 }
 
 //-----------------------------------------------------------------------------
 
 template <typename T>
-SquareMatrix<T>::SquareMatrix(int size)
-	: m_size(size), m_matrix(size, std::vector<T>(size))
+SquareMatrix<T>::SquareMatrix(std::size_t size)
+	: SquareMatrix(size, Uninitialized{})
+{
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		for (std::size_t j = 0; j < size; ++j)
+		{
+			(*this)(i, j) = static_cast<T>(i * size + j);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+SquareMatrix<T>::SquareMatrix(std::size_t size, Uninitialized, const allocator_type& allocator)
+	: m_size(size), m_stride(paddedStride(size)), m_matrix(size * m_stride, allocator)
+{
+	clearPadding();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+typename SquareMatrix<T>::allocator_type SquareMatrix<T>::get_allocator() const
+{
+	return m_matrix.get_allocator();
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void SquareMatrix<T>::clearPadding()
 {
-	for (int i = 0; i < size * size; ++i)
+	if (m_stride == m_size) return;
+
+	for (std::size_t i = 0; i < m_size; ++i)
 	{
-		m_matrix[i / size][i % size] = i;
+		std::fill(data() + i * m_stride + m_size, data() + (i + 1) * m_stride, T{});
 	}
 }
 
@@ -173,12 +499,21 @@ SquareMatrix<T> SquareMatrix<T>::operator-(const SquareMatrix& rhs) const
 template <typename T>
 SquareMatrix<T>& SquareMatrix<T>::operator+=(const SquareMatrix& rhs)
 {
-	for (int i = 0; i < m_size; ++i)
+	if constexpr (std::is_same_v<T, int>)
+	{
+		if (!MatrixKernels::add(data(), data(), rhs.data(), m_matrix.size(),
+		                        lowBound<int>(), highBound<int>(), s_rangePolicy))
+		{
+			rangeError();
+		}
+	}
+	else
 	{
-		for (int j = 0; j < m_size; ++j)
+		using Wide = ElementKernels::Wide<T>;
+		if (!ElementKernels::add(data(), data(), rhs.data(), m_matrix.size(),
+		                         lowBound<Wide>(), highBound<Wide>(), s_rangePolicy))
 		{
-			m_matrix[i][j] += rhs.m_matrix[i][j];
-			checkValidValue(m_matrix[i][j]);
+			rangeError();
 		}
 	}
 	return *this;
@@ -189,12 +524,21 @@ SquareMatrix<T>& SquareMatrix<T>::operator+=(const SquareMatrix& rhs)
 template <typename T>
 SquareMatrix<T>& SquareMatrix<T>::operator-=(const SquareMatrix& rhs)
 {
-	for (int i = 0; i < m_size; ++i)
+	if constexpr (std::is_same_v<T, int>)
 	{
-		for (int j = 0; j < m_size; ++j)
+		if (!MatrixKernels::sub(data(), data(), rhs.data(), m_matrix.size(),
+		                        lowBound<int>(), highBound<int>(), s_rangePolicy))
 		{
-			m_matrix[i][j] -= rhs.m_matrix[i][j];
-			checkValidValue(m_matrix[i][j]);
+			rangeError();
+		}
+	}
+	else
+	{
+		using Wide = ElementKernels::Wide<T>;
+		if (!ElementKernels::sub(data(), data(), rhs.data(), m_matrix.size(),
+		                         lowBound<Wide>(), highBound<Wide>(), s_rangePolicy))
+		{
+			rangeError();
 		}
 	}
 	return *this;
@@ -203,32 +547,100 @@ SquareMatrix<T>& SquareMatrix<T>::operator-=(const SquareMatrix& rhs)
 //-----------------------------------------------------------------------------
 
 template <typename T>
-SquareMatrix<T> SquareMatrix<T>::Transpose() const
+SquareMatrix<T> SquareMatrix<T>::Transpose() const&
 {
-	SquareMatrix result(m_size);
-	for (int i = 0; i < m_size; ++i)
-	{
-		for (int j = 0; j < m_size; ++j)
-		{
-			result(i, j) = m_matrix[j][i];
-		}
-	}
+	SquareMatrix result(m_size, Uninitialized{});
+	transposeBlocked(view(), result.view());
 	return result;
 }
 
 //-----------------------------------------------------------------------------
 
+// A temporary is transposed in its own buffer instead of allocating a new one
+template <typename T>
+SquareMatrix<T> SquareMatrix<T>::Transpose() &&
+{
+	transposeInPlace();
+	return std::move(*this);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void SquareMatrix<T>::transposeInPlace()
+{
+	::transposeInPlace(view());
+}
+
+//-----------------------------------------------------------------------------
+
 template <typename T>
 SquareMatrix<T> SquareMatrix<T>::operator*(const T& scalar) const
 {
 	SquareMatrix result(*this);
-	for (int i = 0; i < m_size; ++i)
+	if constexpr (std::is_same_v<T, int>)
 	{
-		for (int j = 0; j < m_size; ++j)
+		if (!MatrixKernels::scale(result.data(), result.data(), scalar, m_matrix.size(),
+		                          lowBound<int>(), highBound<int>(), s_rangePolicy))
 		{
-			result(i, j) *= scalar;
-			checkValidValue(result(i, j));
+			rangeError();
 		}
 	}
+	else
+	{
+		using Wide = ElementKernels::Wide<T>;
+		if (!ElementKernels::scale(result.data(), result.data(), scalar, m_matrix.size(),
+		                           lowBound<Wide>(), highBound<Wide>(), s_rangePolicy))
+		{
+			rangeError();
+		}
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------------------
+
+// Matrix product, range-checked once per output tile of the GEMM kernel
+template <typename T>
+SquareMatrix<T> SquareMatrix<T>::operator*(const SquareMatrix& rhs) const
+{
+	SquareMatrix result(m_size, Uninitialized{});
+	result.assignProduct(*this, rhs);
 	return result;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void SquareMatrix<T>::assignProduct(const SquareMatrix& lhs, const SquareMatrix& rhs)
+{
+	// Bands of GEMM_MC rows of the result are independent: every task packs
+	// its own panels and checks its own tiles
+	ThreadPool& pool = ThreadPool::instance();
+	const std::size_t bands = (m_size + GEMM_MC - 1) / GEMM_MC;
+	const std::size_t tasks = std::min(bands, pool.taskCount(m_size * m_size * m_size));
+
+	pool.parallelFor(tasks, [&](std::size_t task)
+	{
+		const std::size_t begin = std::min(m_size, bands * task / tasks * GEMM_MC);
+		const std::size_t end = std::min(m_size, bands * (task + 1) / tasks * GEMM_MC);
+		const auto a = lhs.subview(begin, 0, end - begin, m_size);
+		const auto c = subview(begin, 0, end - begin, m_size);
+
+		bool inRange;
+		if constexpr (std::is_same_v<T, int>)
+		{
+			inRange = MatrixKernels::gemm(a, rhs.view(), c,
+			                              lowBound<std::int64_t>(), highBound<std::int64_t>(), s_rangePolicy);
+		}
+		else
+		{
+			using Tile = typename GemmTraits<T>::Tile;
+			inRange = gemmBlocked(a, rhs.view(), c, lowBound<Tile>(), highBound<Tile>(), s_rangePolicy);
+		}
+		if (!inRange)
+		{
+			rangeError();
+		}
+	});
+}
@@ -7,6 +7,7 @@ class Sub : public BinaryOperation
 {
 public:
     using BinaryOperation::BinaryOperation;
-    T compute(const std::vector<T>& input) const override;
+    T compute(Inputs input) const override;
+    void accept(OperationVisitor& visitor) const override;
     void printSymbol(std::ostream& ostr) const override;
 };
@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Least work (in element operations) worth a task of its own
+const std::size_t PARALLEL_MIN_WORK = std::size_t{ 1 } << 16;
+// Upper bound for --threads
+const std::size_t MAX_THREAD_COUNT = 256;
+
+// Fork-join pool with work stealing. Every thread owns a queue: it forks work
+// onto the back of its queue and takes its own work back from there (newest
+// first), while an idle thread steals from the front of another queue (the
+// oldest, i.e. largest, piece of a split range). A thread waiting for a join
+// runs other queued work in the meantime, so nested joins cannot starve.
+// A thread from outside the pool takes part in the work too: for its
+// outermost join it claims one of threadCount() caller queues with a single
+// atomic exchange, so callers never wait for each other. A caller that finds
+// them all claimed runs its join inline (the threads are all busy anyway).
+// With a single thread everything runs inline, in order.
+// Errors are deterministic: a join rethrows the exception of its first part
+// when both parts threw, as if they had run one after the other.
+class ThreadPool
+{
+public:
+	// 'threads' counts the calling thread, so threads - 1 workers are started
+	explicit ThreadPool(std::size_t threads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Sets the size of the pool instance() creates (0 = one per hardware
+	// thread); must be called before instance() is first used
+	static void configure(std::size_t threads);
+	static ThreadPool& instance();
+
+	std::size_t threadCount() const { return m_workers.size() + 1; }
+	// Number of tasks to split 'work' element operations into
+	std::size_t taskCount(std::size_t work) const;
+
+	// Runs first() and second(), the second possibly on another thread
+	template <typename First, typename Second>
+	void join(First&& first, Second&& second);
+
+	// Runs f(i) for every i in [0, count), splitting the range in halves.
+	// The exception of the lowest i that threw is the one rethrown.
+	template <typename Function>
+	void parallelFor(std::size_t count, Function&& f);
+
+private:
+	struct Job
+	{
+		// Refers to the caller's function object, which outlives the job
+		std::function<void()> run;
+		std::atomic<bool> done = false;
+		std::exception_ptr error;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job*> jobs;
+		// A caller queue claimed by a thread from outside the pool
+		std::atomic<bool> claimed = false;
+	};
+
+	// Makes a thread from outside the pool the owner of a free caller queue
+	// for the duration of its outermost join
+	class CallerScope
+	{
+	public:
+		explicit CallerScope(ThreadPool& pool);
+		~CallerScope();
+		CallerScope(const CallerScope&) = delete;
+		CallerScope& operator=(const CallerScope&) = delete;
+
+		// The calling thread owns a queue of the pool
+		bool joined() const { return t_pool == &m_pool; }
+
+	private:
+		ThreadPool& m_pool;
+		Queue* m_claimed = nullptr;
+	};
+
+	template <typename Function>
+	void split(std::size_t begin, std::size_t end, Function& f);
+
+	void push(Job& job);
+	// Takes 'job' back when it is still the newest job of this thread's queue
+	bool takeBack(Job& job);
+	// The newest job of this thread's queue, or the oldest of another one
+	Job* take();
+	void execute(Job& job);
+	// Runs other jobs until 'job' is done
+	void waitFor(Job& job);
+	void work(std::size_t queue, std::stop_token stop);
+
+	inline static std::size_t s_configuredThreads = 1;
+	inline static thread_local ThreadPool* t_pool = nullptr;
+	inline static thread_local std::size_t t_queue = 0;
+
+	// The queues of the workers, then the caller queues
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::atomic<std::size_t> m_pending = 0;
+	std::mutex m_idleMutex;
+	std::condition_variable_any m_idle;
+	std::vector<std::jthread> m_workers;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename First, typename Second>
+void ThreadPool::join(First&& first, Second&& second)
+{
+	if (threadCount() == 1)
+	{
+		first();
+		second();
+		return;
+	}
+
+	CallerScope scope(*this);
+	if (!scope.joined())
+	{
+		first();
+		second();
+		return;
+	}
+
+	Job job;
+	job.run = [&second] { second(); };
+	push(job);
+
+	std::exception_ptr error;
+	try
+	{
+		first();
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	// Not stolen: run it here - unless first() failed, then it is not needed
+	if (takeBack(job))
+	{
+		if (error) std::rethrow_exception(error);
+		second();
+		return;
+	}
+
+	waitFor(job);
+	if (error) std::rethrow_exception(error);
+	if (job.error) std::rethrow_exception(job.error);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename Function>
+void ThreadPool::parallelFor(std::size_t count, Function&& f)
+{
+	if (threadCount() == 1)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+			f(i);
+		return;
+	}
+	if (count > 0)
+		split(0, count, f);
+}
+
+//-----------------------------------------------------------------------------
+
+template <typename Function>
+void ThreadPool::split(std::size_t begin, std::size_t end, Function& f)
+{
+	if (end - begin == 1)
+	{
+		f(begin);
+		return;
+	}
+
+	const std::size_t middle = begin + (end - begin) / 2;
+	join([&] { split(begin, middle, f); }, [&] { split(middle, end, f); });
+}
@@ -8,7 +8,8 @@ class Transpose : public UnaryOperation
 {
 public:
     using UnaryOperation::UnaryOperation;
-    T compute(const std::vector<T>& input) const override;
+    T compute(Inputs input) const override;
+    void accept(OperationVisitor& visitor) const override;
     void print(std::ostream& ostr, bool first_print = false) const override;
 
 };
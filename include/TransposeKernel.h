@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include "MatrixView.h"
+
+// Cache-oblivious transpose kernels.
+// The matrix is split recursively along its larger dimension until a block
+// fits comfortably in L1, so both the reads and the writes stay cache-friendly
+// at every level of the memory hierarchy without tuning for a specific cache.
+
+// Side of the largest block handled directly by the base case
+const std::size_t TRANSPOSE_BLOCK = 16;
+
+//-----------------------------------------------------------------------------
+
+// dst(j, i) = src(i, j) - dst must be src.cols() x src.rows() and not overlap src
+template <typename T>
+void transposeBlocked(MatrixView<const T> src, MatrixView<T> dst)
+{
+	const std::size_t rows = src.rows(), cols = src.cols();
+
+	if (rows <= TRANSPOSE_BLOCK && cols <= TRANSPOSE_BLOCK)
+	{
+		for (std::size_t i = 0; i < rows; ++i)
+		{
+			const T* srcRow = src.row(i).data();
+			for (std::size_t j = 0; j < cols; ++j)
+			{
+				dst(j, i) = srcRow[j];
+			}
+		}
+		return;
+	}
+
+	if (rows >= cols)
+	{
+		const std::size_t half = rows / 2;
+		transposeBlocked(src.subview(0, 0, half, cols), dst.subview(0, 0, cols, half));
+		transposeBlocked(src.subview(half, 0, rows - half, cols),
+		                 dst.subview(0, half, cols, rows - half));
+	}
+	else
+	{
+		const std::size_t half = cols / 2;
+		transposeBlocked(src.subview(0, 0, rows, half), dst.subview(0, 0, half, rows));
+		transposeBlocked(src.subview(0, half, rows, cols - half),
+		                 dst.subview(half, 0, cols - half, rows));
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Swaps a(i, j) with b(j, i) - a is rows x cols, b is cols x rows, disjoint
+template <typename T>
+void swapTransposed(MatrixView<T> a, MatrixView<T> b)
+{
+	const std::size_t rows = a.rows(), cols = a.cols();
+
+	if (rows <= TRANSPOSE_BLOCK && cols <= TRANSPOSE_BLOCK)
+	{
+		for (std::size_t i = 0; i < rows; ++i)
+		{
+			T* aRow = a.row(i).data();
+			for (std::size_t j = 0; j < cols; ++j)
+			{
+				std::swap(aRow[j], b(j, i));
+			}
+		}
+		return;
+	}
+
+	if (rows >= cols)
+	{
+		const std::size_t half = rows / 2;
+		swapTransposed(a.subview(0, 0, half, cols), b.subview(0, 0, cols, half));
+		swapTransposed(a.subview(half, 0, rows - half, cols),
+		               b.subview(0, half, cols, rows - half));
+	}
+	else
+	{
+		const std::size_t half = cols / 2;
+		swapTransposed(a.subview(0, 0, rows, half), b.subview(0, 0, half, rows));
+		swapTransposed(a.subview(0, half, rows, cols - half),
+		               b.subview(half, 0, cols - half, rows));
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+// Transposes a square view in place: the diagonal quadrants are transposed
+// recursively and the off-diagonal quadrants are swapped with each other
+template <typename T>
+void transposeInPlace(MatrixView<T> matrix)
+{
+	const std::size_t size = matrix.rows();
+
+	if (size <= TRANSPOSE_BLOCK)
+	{
+		for (std::size_t i = 1; i < size; ++i)
+		{
+			for (std::size_t j = 0; j < i; ++j)
+			{
+				std::swap(matrix(i, j), matrix(j, i));
+			}
+		}
+		return;
+	}
+
+	const std::size_t half = size / 2;
+	transposeInPlace(matrix.subview(0, 0, half, half));
+	transposeInPlace(matrix.subview(half, half, size - half, size - half));
+	swapTransposed(matrix.subview(0, half, half, size - half),
+	               matrix.subview(half, 0, size - half, half));
+}
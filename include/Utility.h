@@ -4,6 +4,9 @@ enum class Action
 {
     Invalid,
     Eval,
+    Profile,
+    EvalBatch,
+    Convert,
     Iden,
     Tran,
     Scal,
@@ -14,9 +17,27 @@ enum class Action
     Del,
     Resize,
     Read,
+    Stats,
     Help,
     Exit,
 };
 
 const int MAX_ALLOWED_VALUE = 1000;
-const int MIN_ALLOWED_VALUE = -1024;
\ No newline at end of file
+const int MIN_ALLOWED_VALUE = -1024;
+const char* const RANGE_ERROR_MESSAGE = "Value is out of the allowed range!";
+
+// Whether matrix values are checked against the allowed range
+enum class RangePolicy
+{
+    Checked,
+    Unchecked,
+};
+
+// What a script run by read does when one of its commands fails
+enum class ScriptPolicy
+{
+    Ask,     // asks on std::cin whether to go on
+    Abort,   // stops, and so do the scripts that read it
+    Skip,    // reports the failure and goes on
+    Collect, // goes on, and reports all the failures at the end
+};
@@ -1,11 +1,50 @@
 #include "BinaryOperation.h"
+#include "ThreadPool.h"
 #include <iostream>
+#include <optional>
 
 //-----------------------------------------------------------------------------
 
 BinaryOperation::BinaryOperation(const std::shared_ptr<Operation>& first, 
                                  const std::shared_ptr<Operation>& second)
-    : m_first(first), m_second(second) {}
+    : BinaryOperation(first, second, 0) {}
+
+//-----------------------------------------------------------------------------
+
+BinaryOperation::BinaryOperation(const std::shared_ptr<Operation>& first,
+                                 const std::shared_ptr<Operation>& second, int sharedInputs)
+    : m_first(first), m_second(second),
+      m_inputCount(first->inputCount() + second->inputCount() - sharedInputs),
+      m_secondOffset(static_cast<std::size_t>(first->inputCount())) {}
+
+//-----------------------------------------------------------------------------
+
+std::pair<Operation::T, Operation::T> BinaryOperation::computeOperands(Inputs input) const
+{
+    std::optional<T> a, b;
+    const auto computeFirst = [&] { a.emplace(first()->evaluate(input)); };
+    const auto computeSecond = [&] { b.emplace(second()->evaluate(input.subspan(secondOffset()))); };
+
+    // Either operand costs at least a pass over n x n matrices; a profiled
+    // run times them one after the other
+    const std::size_t size = input.front().size();
+    if (size * size >= PARALLEL_MIN_WORK && !Profiler::active())
+        ThreadPool::instance().join(computeFirst, computeSecond);
+    else
+    {
+        computeFirst();
+        computeSecond();
+    }
+    return { std::move(*a), std::move(*b) };
+}
+
+//-----------------------------------------------------------------------------
+
+const FusedExpression* BinaryOperation::fused() const
+{
+    std::call_once(m_fuseOnce, [this] { m_fused = FusedExpression::compile(*this); });
+    return m_fused ? &*m_fused : nullptr;
+}
 
 //-----------------------------------------------------------------------------
 
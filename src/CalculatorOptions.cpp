@@ -0,0 +1,192 @@
+#include "CalculatorOptions.h"
+#include "ThreadPool.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+namespace
+{
+    // Parses "type:low:high" into the allowed range of that element type
+    void parseRange(std::string_view value, AllowedRanges& ranges)
+    {
+        const auto invalid = [value]
+        {
+            return std::invalid_argument("Invalid value for --range: " + std::string(value));
+        };
+
+        const std::size_t first = value.find(':');
+        const std::size_t second = first == std::string_view::npos ? first : value.find(':', first + 1);
+        if (second == std::string_view::npos)
+            throw invalid();
+        const auto type = findElementType(value.substr(0, first));
+        if (!type)
+            throw invalid();
+
+        dispatchElementType(*type, [&]<typename T>()
+        {
+            const auto number = [&](std::string_view text)
+            {
+                T result{};
+                const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), result);
+                if (text.empty() || error != std::errc() || end != text.data() + text.size())
+                    throw invalid();
+                return result;
+            };
+            const T low = number(value.substr(first + 1, second - first - 1));
+            const T high = number(value.substr(second + 1));
+
+            // Like SquareMatrix::setAllowedRange: the row padding (0) must be
+            // allowed, and a NaN bound allows nothing
+            if (!(low <= T{} && T{} <= high))
+                throw invalid();
+            std::get<AllowedRange<T>>(ranges) = std::pair(low, high);
+        });
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+CalculatorOptions CalculatorOptions::parse(int argc, const char* const argv[])
+{
+    CalculatorOptions options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view option = argv[i];
+
+        if (option == "--large")
+        {
+            options.maxMatSize = LARGE_MAX_MAT_SIZE;
+        }
+        else if (option == "--max-size")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --max-size.");
+
+            const std::string value = argv[++i];
+            std::size_t pos;
+            const unsigned long long size = std::stoull(value, &pos);
+            if (pos != value.size() || value.front() == '-' ||
+                size < 1 || size > MAX_CONFIGURABLE_MAT_SIZE)
+            {
+                throw std::invalid_argument("Invalid value for --max-size: " + value);
+            }
+            options.maxMatSize = static_cast<std::size_t>(size);
+        }
+        else if (option == "--no-range-check")
+        {
+            options.rangePolicy = RangePolicy::Unchecked;
+        }
+        else if (option == "--range")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --range.");
+            parseRange(argv[++i], options.allowedRanges);
+        }
+        else if (option == "--element-type")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --element-type.");
+
+            const std::string_view value = argv[++i];
+            const auto type = findElementType(value);
+            if (!type)
+                throw std::invalid_argument("Invalid value for --element-type: " + std::string(value));
+            options.elementType = *type;
+        }
+        else if (option == "--threads")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --threads.");
+
+            const std::string value = argv[++i];
+            std::size_t pos;
+            const unsigned long long threads = std::stoull(value, &pos);
+            if (pos != value.size() || value.front() == '-' || threads > MAX_THREAD_COUNT)
+                throw std::invalid_argument("Invalid value for --threads: " + value);
+            options.threads = static_cast<std::size_t>(threads);
+        }
+        else if (option == "--max-operations")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --max-operations.");
+
+            const std::string value = argv[++i];
+            std::size_t pos;
+            const int limit = std::stoi(value, &pos);
+            if (pos != value.size() || limit < MIN_OPERATION_LIMIT || limit > MAX_OPERATION_LIMIT)
+                throw std::invalid_argument("Invalid value for --max-operations: " + value);
+            options.maxOperations = limit;
+        }
+        else if (option == "--serve")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --serve.");
+            options.servePath = argv[++i];
+        }
+        else if (option == "--no-simplify")
+        {
+            options.simplify = false;
+        }
+        else if (option == "--no-echo")
+        {
+            options.echoInputs = false;
+        }
+        else if (option == "--script-errors")
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument("Missing value for --script-errors.");
+
+            const std::string_view value = argv[++i];
+            if (value == "ask")
+                options.scriptPolicy = ScriptPolicy::Ask;
+            else if (value == "abort")
+                options.scriptPolicy = ScriptPolicy::Abort;
+            else if (value == "skip")
+                options.scriptPolicy = ScriptPolicy::Skip;
+            else if (value == "collect")
+                options.scriptPolicy = ScriptPolicy::Collect;
+            else
+                throw std::invalid_argument("Invalid value for --script-errors: " + std::string(value));
+        }
+        else
+        {
+            throw std::invalid_argument("Unknown option: " + std::string(option));
+        }
+    }
+    return options;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string CalculatorOptions::usage()
+{
+    return "Usage: oop2_ex03 [options]\n"
+           "  --large           allow matrices up to " + std::to_string(LARGE_MAX_MAT_SIZE) +
+           "x" + std::to_string(LARGE_MAX_MAT_SIZE) + "\n"
+           "  --max-size n      allow matrices up to nxn (1 <= n <= " +
+           std::to_string(MAX_CONFIGURABLE_MAT_SIZE) + ")\n"
+           "  --no-range-check  do not check matrix values against the allowed range\n"
+           "  --range t:lo:hi   allow the values lo to hi (lo <= 0 <= hi) in element\n"
+           "                    type t (may be given for each type)\n"
+           "  --element-type t  evaluate in element type t: int16, int (the default),\n"
+           "                    int64, float or double\n"
+           "  --no-simplify     evaluate the operations exactly as they were defined\n"
+           "  --no-echo         do not print the input matrices back in eval results\n"
+           "  --script-errors p what a script does when a command fails: ask (the\n"
+           "                    default), or run unattended and abort, skip, or\n"
+           "                    collect the failures and report them at the end\n"
+           "  --threads n       evaluate large matrices on n threads (0 = all cores, "
+           "up to " + std::to_string(MAX_THREAD_COUNT) + ")\n"
+           "  --max-operations n\n"
+           "                    limit the number of operations to n (" +
+           std::to_string(MIN_OPERATION_LIMIT) + " <= n <= " + std::to_string(MAX_OPERATION_LIMIT) +
+           ")\n"
+           "                    instead of asking for it\n"
+           "  --serve path      serve concurrent sessions on the Unix domain socket\n"
+           "                    'path', sharing one list of operations (the limit is\n"
+           "                    " + std::to_string(MAX_OPERATION_LIMIT) +
+           " unless --max-operations is given)\n";
+}
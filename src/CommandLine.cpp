@@ -0,0 +1,72 @@
+#include "CommandLine.h"
+
+#include <istream>
+
+namespace
+{
+    // The characters operator>> skips
+    bool isSpace(char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandLine::assign(std::string_view line)
+{
+    m_line.assign(line);
+    split();
+}
+
+//-----------------------------------------------------------------------------
+
+bool CommandLine::readLine(std::istream& istr)
+{
+    // A stream that already failed leaves the line as it was
+    if (!std::getline(istr, m_line))
+        m_line.clear();
+    split();
+    return !m_line.empty();
+}
+
+//-----------------------------------------------------------------------------
+
+void CommandLine::split()
+{
+    m_tokens.clear();
+    m_next = 0;
+
+    const std::string_view line = m_line;
+    std::size_t i = 0;
+    while (i < line.size())
+    {
+        while (i < line.size() && isSpace(line[i]))
+            ++i;
+        const std::size_t start = i;
+        while (i < line.size() && !isSpace(line[i]))
+            ++i;
+        if (i > start)
+            m_tokens.push_back(line.substr(start, i - start));
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+std::string_view CommandLine::next()
+{
+    return m_next < m_tokens.size() ? m_tokens[m_next++] : std::string_view();
+}
+
+//-----------------------------------------------------------------------------
+
+std::string_view CommandLine::afterFirst() const
+{
+    if (m_tokens.empty())
+        return std::string_view();
+
+    const std::string_view line = m_line;
+    const std::size_t start = static_cast<std::size_t>(m_tokens.front().data() - line.data()) +
+                              m_tokens.front().size() + 1;
+    return start < line.size() ? line.substr(start) : std::string_view();
+}
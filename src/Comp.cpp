@@ -1,22 +1,25 @@
 #include "Comp.h"
 #include <iostream>
+#include <utility>
 
 //-----------------------------------------------------------------------------
 
-int Comp::inputCount() const
-{
-    return first()->inputCount() + second()->inputCount() - 1;
-}
+Comp::Comp(const std::shared_ptr<Operation>& first, const std::shared_ptr<Operation>& second)
+    : BinaryOperation(first, second, 1) {}
 
 //-----------------------------------------------------------------------------
 
-Operation::T Comp::compute(const std::vector<T>& input) const
+Operation::T Comp::compute(Inputs input) const
 {
-    const auto resultOfFirst = first()->compute(input);
-    auto firstCount = first()->inputCount();
-    std::vector input2(input.begin() + firstCount, input.end());
-	input2.insert(input2.begin(), resultOfFirst);
-    return second()->compute(input2);
+    // The linear part of the tree (sums, differences, scalars and transposes)
+    // is computed in a single pass over the inputs - unless it is profiled
+    if (const FusedExpression* expression = Profiler::active() ? nullptr : fused())
+        return expression->evaluate(input);
+
+    // Nothing reads the result of the first operation after the second one,
+    // so the second one may reuse its storage
+    auto resultOfFirst = first()->evaluate(input);
+    return second()->evaluate(Inputs(std::move(resultOfFirst), input.subspan(secondOffset())));
 }
 
 //-----------------------------------------------------------------------------
@@ -25,3 +28,10 @@ void Comp::printSymbol(std::ostream& ostr) const
 {
     ostr << " -> ";
 }
+
+//-----------------------------------------------------------------------------
+
+void Comp::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
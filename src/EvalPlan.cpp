@@ -0,0 +1,211 @@
+#include "EvalPlan.h"
+#include "BinaryOperation.h"
+#include "Comp.h"
+
+#include <cstdint>
+#include <numeric>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+
+EvalPlan::EvalPlan(const Operation& operation, std::size_t size)
+    : m_size(size), m_inputCount(static_cast<std::size_t>(operation.inputCount())),
+      m_valueCount(m_inputCount)
+{
+    std::vector<std::size_t> inputs(m_inputCount);
+    std::iota(inputs.begin(), inputs.end(), std::size_t{ 0 });
+
+    Planned planned;
+    m_schedule.result = plan(operation, inputs, planned);
+    assignBuffers();
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t EvalPlan::addStep(Step step)
+{
+    step.output = m_valueCount++;
+    m_schedule.steps.push_back(std::move(step));
+    return m_schedule.steps.back().output;
+}
+
+//-----------------------------------------------------------------------------
+
+// A node of the DAG reached through several parents is planned once for
+// each distinct set of operand slots it is reached with
+std::size_t EvalPlan::plan(const Operation& operation, std::span<const std::size_t> inputs,
+                           Planned& planned)
+{
+    const auto operands = inputs.first(static_cast<std::size_t>(operation.inputCount()));
+    auto key = std::make_pair(&operation, std::vector<std::size_t>(operands.begin(), operands.end()));
+    if (const auto earlier = planned.find(key); earlier != planned.end())
+        return earlier->second;
+
+    const std::size_t value = planSteps(operation, inputs, planned);
+    planned.emplace(std::move(key), value);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t EvalPlan::planSteps(const Operation& operation, std::span<const std::size_t> inputs,
+                                Planned& planned)
+{
+    if (auto fused = FusedExpression::compile(operation))
+    {
+        // The nodes left out of the fused program are planned first, in order
+        Step step;
+        step.kernel = Kernel::Fused;
+        for (const auto& source : fused->sources())
+        {
+            step.operands.push_back(source.opaque
+                                        ? plan(*source.opaque, inputs.subspan(source.offset), planned)
+                                        : inputs[source.offset]);
+        }
+
+        // Nothing to compute (an identity): the value is used as it is
+        if (fused->copiesSource())
+            return step.operands.front();
+
+        step.expression = m_expressions.size();
+        m_expressions.push_back(std::move(*fused));
+        return addStep(std::move(step));
+    }
+
+    // Not fusable at the root: a product, or a Comp feeding a product
+    const auto& binary = dynamic_cast<const BinaryOperation&>(operation);
+    const std::size_t first = plan(*binary.first(), inputs, planned);
+
+    if (dynamic_cast<const Comp*>(&operation))
+    {
+        std::vector<std::size_t> second{ first };
+        const auto rest = inputs.subspan(binary.secondOffset(),
+                                         static_cast<std::size_t>(operation.inputCount()) -
+                                         binary.secondOffset());
+        second.insert(second.end(), rest.begin(), rest.end());
+        return plan(*binary.second(), second, planned);
+    }
+
+    const std::size_t second = plan(*binary.second(), inputs.subspan(binary.secondOffset()), planned);
+    return addStep({ .kernel = Kernel::Product, .operands = { first, second } });
+}
+
+//-----------------------------------------------------------------------------
+
+// Linear scan over the steps: a buffer is released after the step that reads
+// its value for the last time. A fused step without transposed reads works
+// tile by tile, so it may write into a buffer it reads in the same step.
+void EvalPlan::assignBuffers()
+{
+    auto& steps = m_schedule.steps;
+    const std::size_t NEVER = SIZE_MAX;
+    std::vector<std::size_t> lastUse(m_valueCount, NEVER);
+    for (std::size_t i = 0; i < steps.size(); ++i)
+    {
+        for (const std::size_t value : steps[i].operands)
+            lastUse[value] = i;
+    }
+    // The result is still needed after the last step
+    lastUse[m_schedule.result] = NEVER;
+
+    std::vector<std::size_t> slots(m_valueCount);
+    std::iota(slots.begin(), slots.begin() + static_cast<std::ptrdiff_t>(m_inputCount),
+              std::size_t{ 0 });
+    std::vector<std::size_t> freeSlots;
+
+    const auto release = [&](std::size_t i)
+    {
+        for (const std::size_t value : steps[i].operands)
+        {
+            if (value >= m_inputCount && lastUse[value] == i)
+            {
+                freeSlots.push_back(slots[value]);
+                lastUse[value] = NEVER;
+            }
+        }
+    };
+
+    for (std::size_t i = 0; i < steps.size(); ++i)
+    {
+        Step& step = steps[i];
+        const bool inPlace = step.kernel == Kernel::Fused &&
+                             !m_expressions[step.expression].readsTransposed();
+        if (inPlace)
+            release(i);
+
+        if (freeSlots.empty())
+            freeSlots.push_back(m_inputCount + m_schedule.bufferCount++);
+        slots[step.output] = freeSlots.back();
+        freeSlots.pop_back();
+
+        if (!inPlace)
+            release(i);
+    }
+
+    for (auto& step : steps)
+    {
+        for (auto& operand : step.operands)
+            operand = slots[operand];
+        step.output = slots[step.output];
+    }
+    m_schedule.result = slots[m_schedule.result];
+}
+
+//-----------------------------------------------------------------------------
+
+Operation::T EvalPlan::run(std::span<const T> input) const
+{
+    Workspace workspace;
+    const std::size_t result = execute(input, workspace);
+
+    if (result < m_inputCount)
+        return input[result];
+    return std::move(workspace.buffers[result - m_inputCount]);
+}
+
+//-----------------------------------------------------------------------------
+
+const Operation::T& EvalPlan::run(std::span<const T> input, Workspace& workspace) const
+{
+    const std::size_t result = execute(input, workspace);
+
+    if (result < m_inputCount)
+        return input[result];
+    return workspace.buffers[result - m_inputCount];
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t EvalPlan::execute(std::span<const T> input, Workspace& workspace) const
+{
+    // Buffers are numbered in the order they are first written, so the
+    // buffers of an earlier run are reused as they are
+    auto& buffers = workspace.buffers;
+    auto& sources = workspace.sources;
+    buffers.reserve(m_schedule.bufferCount);
+
+    const auto slot = [&](std::size_t index) -> const T&
+    {
+        return index < m_inputCount ? input[index] : buffers[index - m_inputCount];
+    };
+
+    for (const auto& step : m_schedule.steps)
+    {
+        if (step.output - m_inputCount == buffers.size())
+            buffers.emplace_back(m_size, T::Uninitialized{});
+        T& output = buffers[step.output - m_inputCount];
+
+        if (step.kernel == Kernel::Product)
+        {
+            output.assignProduct(slot(step.operands[0]), slot(step.operands[1]));
+            continue;
+        }
+
+        sources.clear();
+        for (const std::size_t operand : step.operands)
+            sources.push_back(&slot(operand));
+        m_expressions[step.expression].run(sources, output);
+    }
+
+    return m_schedule.result;
+}
@@ -2,28 +2,171 @@
 #include "SquareMatrix.h"
 #include "Add.h"
 #include "Sub.h"
+#include "Mul.h"
 #include "Comp.h"
 #include "Identity.h"
 #include "Transpose.h"
 #include "Scalar.h"
+#include "FixedEvaluator.h"
+#include "MatrixEvaluator.h"
+#include "Simplifier.h"
+#include "BatchEval.h"
+#include "MatrixFile.h"
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <array>
+#include <charconv>
+#include <memory_resource>
+#include <type_traits>
+#include "PerfectHash.h"
+
+namespace
+{
+    struct ActionDetails
+    {
+        std::string_view command;
+        std::string_view description;
+        Action action;
+    };
+
+    // The commands, in the order help lists them
+    constexpr auto ACTIONS = std::to_array<ActionDetails>({
+        {
+            "eval",
+            "(uate) num n [--profile] [--type t] - compute the result of function #num on "
+                "an nxn matrix (that will be prompted), in element type t (int16, int, int64, "
+                "float or double)",
+            Action::Eval
+        },
+        {
+            "profile",
+            " num n [--type t] - eval num n, then print the calls, time and bytes of every "
+                "node of the operation",
+            Action::Profile
+        },
+        {
+            "evalbatch",
+            " num n file - compute the result of function #num on every set of nxn "
+                "matrices in file; the results are written to file.out",
+            Action::EvalBatch
+        },
+        {
+            "convert",
+            " n source target - convert the nxn matrices in source between text and "
+                "a binary matrix file (written to target)",
+            Action::Convert
+        },
+        {
+            "scal",
+            "(ar) val - creates an operation that multiplies the "
+                "given matrix by scalar val",
+            Action::Scal
+        },
+        {
+            "add",
+            " num1 num2 - creates an operation that is the addition of the result "
+                "of operation #num1 and the result of operation #num2",
+            Action::Add
+        },
+        {
+            "sub",
+            " num1 num2 - creates an operation that is the subtraction of the result "
+                "of operation #num1 and the result of operation #num2",
+            Action::Sub
+        },
+        {
+            "mul",
+            " num1 num2 - creates an operation that is the matrix product of the result "
+                "of operation #num1 and the result of operation #num2",
+            Action::Mul
+        },
+        {
+            "comp",
+            "(osite) num1 num2 - creates an operation that is the composition of "
+                "operation #num1 and operation #num2",
+            Action::Comp
+        },
+        {
+            "del",
+            "(ete) num - delete operation #num from the operation list",
+            Action::Del
+        },
+        {
+            "resize",
+            " num - resize the maximum number of operations to num (2 <= num <= 100)",
+            Action::Resize
+        },
+        {
+            "read",
+            " pathFile - execute operations from a file",
+            Action::Read
+        },
+        {
+            "stats",
+            " [--json] - print the memory held by the operations and by matrices "
+                "(--json: as one line of JSON)",
+            Action::Stats
+        },
+        {
+            "help",
+            " - print this command list",
+            Action::Help
+        },
+        {
+            "exit",
+            " - exit the program",
+            Action::Exit
+        }
+    });
+
+    // The option of eval that profiles it
+    constexpr std::string_view PROFILE_FLAG = "--profile";
+    // The option of eval that sets the element type
+    constexpr std::string_view TYPE_FLAG = "--type";
+    // The option of stats that prints JSON
+    constexpr std::string_view JSON_FLAG = "--json";
+
+    // Finds a command with one hash and one comparison
+    constexpr PerfectHash<ACTIONS.size()> ACTION_HASH([]
+    {
+        std::array<std::string_view, ACTIONS.size()> commands;
+        for (std::size_t i = 0; i < ACTIONS.size(); ++i)
+            commands[i] = ACTIONS[i].command;
+        return commands;
+    }());
+}
+
+//-----------------------------------------------------------------------------
+
+FunctionCalculator::FunctionCalculator(std::istream& istr, std::ostream& ostr,
+                                       const CalculatorOptions& options)
+    : FunctionCalculator(istr, ostr, std::make_shared<OperationRegistry>(options.maxOperations),
+                         options) { }
 
 //-----------------------------------------------------------------------------
 
-FunctionCalculator::FunctionCalculator(std::istream& istr, std::ostream& ostr)
-    : m_actions(createActions()), m_operations(createOperations()), 
-      m_istr(istr), m_ostr(ostr), m_iss("") { }
+FunctionCalculator::FunctionCalculator(std::istream& istr, std::ostream& ostr,
+                                       std::shared_ptr<OperationRegistry> registry,
+                                       const CalculatorOptions& options)
+    : m_registry(std::move(registry)), m_snapshot(m_registry->current()),
+      m_istr(istr), m_ostr(ostr), m_options(options) { }
 
 //-----------------------------------------------------------------------------
 
 void FunctionCalculator::run()
 {
-    getMaxOperation();
+    if (m_snapshot->maxOperations == 0)
+        getMaxOperation();
 
-    do
+    while (m_running)
     {
+        // The changes of other sessions show from here on
+        setSnapshot(m_registry->current());
+
         m_ostr << '\n';
         printOperations();
         m_ostr << "Enter command ('help' for the list of available commands): ";
@@ -32,15 +175,15 @@ void FunctionCalculator::run()
         {
 			m_currInput = Action::Invalid;
             getUserCommand();
-            executeCommand();
+            if (m_running)
+                executeCommand();
         }
 		catch (const std::exception& e)
 		{
 			m_ostr << "Error: " << e.what() << '\n';
 			continue;
 		}
-        
-    } while (m_running);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -53,40 +196,92 @@ void FunctionCalculator::executeCommand()
 
 //-----------------------------------------------------------------------------
 
-void FunctionCalculator::setStreams(std::string input)
+void FunctionCalculator::setStreams(std::string_view input)
 {
-	m_iss.clear();
-    m_iss.str(input);
+    m_command.assign(input);
 }
 
 //-----------------------------------------------------------------------------
 
-void FunctionCalculator::eval()
+void FunctionCalculator::eval(bool profiled)
 {
+    // The matrices of the eval are measured however it ends
+    const MemoryStats::PeakScope peak(m_lastEvalPeakBytes);
     try
     {
-        validNumOfArguments(TWO_ARGS);
-        int index = readOperationIndex();
-        int size = getSizeMat();
+        // eval takes --profile and --type t after its arguments
+        compare(static_cast<int>(m_command.size()) - 1 < TWO_ARGS);
+        const std::size_t index = readOperationIndex();
+        std::size_t size = getSizeMat();
+        ElementType type = m_options.elementType;
+        for (auto option = m_command.next(); !option.empty(); option = m_command.next())
+        {
+            if (option == PROFILE_FLAG && !profiled)
+                profiled = true;
+            else if (option == TYPE_FLAG)
+            {
+                const auto found = findElementType(m_command.next());
+                if (!found)
+                    throw OperationExceptionRange("Unknown element type. The element types are "
+                                                  "int16, int, int64, float and double.");
+                type = *found;
+            }
+            else throw OperationExceptionRange("Unknown eval option. The options of eval are "
+                                               "--profile and --type t.");
+        }
 
-        const auto& operation = m_operations[index];
+        const auto& operation = m_snapshot->operations[index];
         int inputCount = operation->inputCount();
-        auto matrixVec = std::vector<Operation::T>();
+        const auto& evaluated = *m_snapshot->evaluated[index];
+
+        // The other element types are computed by MatrixEvaluator
+        if (type != ElementType::Int)
+        {
+            dispatchElementType(type, [&]<typename T>() { evalAs<T>(*operation, evaluated, size, profiled); });
+            return;
+        }
+
+        // Small sizes run on stack matrices whose size is known at compile time
+        if (!profiled &&
+            dispatchFixedSize(size, [&]<std::size_t N>() { evalFixed<N>(*operation, evaluated, inputCount); }))
+            return;
+
+        // The inputs and temporaries of this eval live in an arena that is
+        // dropped at once when it ends; its memory goes back to m_pool
+        std::pmr::monotonic_buffer_resource arena(&m_pool);
+        std::pmr::vector<Operation::T> matrixVec(&arena);
+        matrixVec.reserve(static_cast<std::size_t>(inputCount));
         printNumMat(inputCount);
 
+        // Large matrices are prompted for once and are not echoed back
+        const bool largeMatrices = size > DEFAULT_MAX_MAT_SIZE;
+        if (largeMatrices)
+            m_ostr << "\nEnter the " << size << "x" << size << " matrices, row by row:\n";
+
         for (int i = 0; i < inputCount; ++i)
         {
-            auto input = Operation::T(size);
-            m_ostr << "\nEnter a " << size << "x" << size << " matrix:\n";
+            auto& input = matrixVec.emplace_back(size, Operation::T::Uninitialized{});
+            if (!largeMatrices)
+                m_ostr << "\nEnter a " << size << "x" << size << " matrix:\n";
             m_istr >> input;
-
-            matrixVec.push_back(input);
         }
 
         m_ostr << "\n";
-        operation->print(m_ostr, matrixVec);
+        if (largeMatrices || !m_options.echoInputs)
+        {
+            operation->print(m_ostr);
+            m_ostr << " on " << inputCount << ' ' << size << 'x' << size << " matrices";
+        }
+        else operation->print(m_ostr, matrixVec);
 
-        m_ostr << " = \n" << operation->compute(matrixVec);
+        if (profiled)
+        {
+            evalProfiled(evaluated, matrixVec);
+            return;
+        }
+
+        EvalPlan::Workspace workspace(&arena);
+        m_ostr << " = \n" << getPlan(m_snapshot->evaluated[index], size).run(matrixVec, workspace);
     }
     // Catches for the matrices alone
     catch (const std::runtime_error& e)
@@ -101,6 +296,283 @@ void FunctionCalculator::eval()
 
 //-----------------------------------------------------------------------------
 
+// Computes 'evaluated' node by node under a profiler, and prints the result
+// and then the counters of every node
+void FunctionCalculator::evalProfiled(const Operation& evaluated, std::span<const Operation::T> input)
+{
+    Profiler profiler;
+    const Operation::T result = evaluated.evaluate(input);
+
+    m_ostr << " = \n" << result << "\nProfile of the operation as it is computed:";
+    profiler.print(m_ostr, evaluated);
+}
+
+//-----------------------------------------------------------------------------
+
+// eval() in element type T, with the same prompts and output
+template <typename T>
+void FunctionCalculator::evalAs(const Operation& operation, const Operation& evaluated,
+                                std::size_t size, bool profiled)
+{
+    using Matrix = SquareMatrix<T>;
+    const int inputCount = operation.inputCount();
+    // The Simplifier rewrites by int rules (its folded scalars wrap modulo
+    // 2^32, and folding is not exact in floating point), so only the integer
+    // types no wider than int compute its result; the others compute the
+    // operation as it was defined
+    const Operation& computed = std::is_integral_v<T> && sizeof(T) <= sizeof(int) ? evaluated : operation;
+
+    std::pmr::monotonic_buffer_resource arena(&m_pool);
+    std::pmr::vector<Matrix> matrixVec(&arena);
+    matrixVec.reserve(static_cast<std::size_t>(inputCount));
+    printNumMat(inputCount);
+
+    const bool largeMatrices = size > DEFAULT_MAX_MAT_SIZE;
+    if (largeMatrices)
+        m_ostr << "\nEnter the " << size << "x" << size << " matrices, row by row:\n";
+
+    for (int i = 0; i < inputCount; ++i)
+    {
+        auto& input = matrixVec.emplace_back(size, typename Matrix::Uninitialized{});
+        if (!largeMatrices)
+            m_ostr << "\nEnter a " << size << "x" << size << " matrix:\n";
+        m_istr >> input;
+    }
+
+    m_ostr << "\n";
+    operation.print(m_ostr);
+    if (largeMatrices || !m_options.echoInputs)
+        m_ostr << " on " << inputCount << ' ' << size << 'x' << size << " matrices";
+    else
+    {
+        auto& formatter = MatrixFormatter::local();
+        for (const auto& input : matrixVec)
+        {
+            formatter.append("(\n").append(input.view()).append(")");
+        }
+        formatter.flush(m_ostr);
+    }
+
+    const std::span<const Matrix> input(matrixVec);
+    if (!profiled)
+    {
+        m_ostr << " = \n" << MatrixEvaluator<T>().evaluate(computed, input);
+        return;
+    }
+
+    Profiler profiler;
+    const Matrix result = MatrixEvaluator<T>().evaluate(computed, input);
+    m_ostr << " = \n" << result << "\nProfile of the operation as it is computed:";
+    profiler.print(m_ostr, computed);
+}
+
+//-----------------------------------------------------------------------------
+
+// eval() for N <= MAX_FIXED_MAT_SIZE, with the same prompts and output
+template <std::size_t N>
+void FunctionCalculator::evalFixed(const Operation& operation, const Operation& evaluated,
+                                   int inputCount)
+{
+    using Matrix = FixedSquareMatrix<int, N>;
+
+    // Kept between calls, so repeated evals of one size do not allocate
+    thread_local std::vector<Matrix> matrixVec;
+    matrixVec.resize(static_cast<std::size_t>(inputCount));
+    printNumMat(inputCount);
+
+    constexpr bool largeMatrices = N > DEFAULT_MAX_MAT_SIZE;
+    if (largeMatrices)
+        m_ostr << "\nEnter the " << N << "x" << N << " matrices, row by row:\n";
+
+    for (auto& input : matrixVec)
+    {
+        if (!largeMatrices)
+            m_ostr << "\nEnter a " << N << "x" << N << " matrix:\n";
+        m_istr >> input;
+    }
+
+    m_ostr << "\n";
+    operation.print(m_ostr);
+    if (largeMatrices || !m_options.echoInputs)
+        m_ostr << " on " << inputCount << ' ' << N << 'x' << N << " matrices";
+    else
+    {
+        // Rendered together and written at once, like Operation::print
+        auto& formatter = MatrixFormatter::local();
+        for (const auto& input : matrixVec)
+        {
+            formatter.append("(\n").append(input.view()).append(")");
+        }
+        formatter.flush(m_ostr);
+    }
+
+    m_ostr << " = \n" << FixedEvaluator<N>().evaluate(evaluated, std::span<const Matrix>(matrixVec));
+}
+
+//-----------------------------------------------------------------------------
+
+// evalbatch num n file: every set of inputs in 'file' is evaluated, and the
+// results are written to 'file'.out - as text, or as a matrix file when
+// 'file' is one
+void FunctionCalculator::evalBatch()
+{
+    try
+    {
+        validNumOfArguments(THREE_ARGS);
+        if (m_options.elementType != ElementType::Int)
+            throw OperationExceptionRange("evalbatch works on int matrices only.");
+        const std::size_t index = readOperationIndex();
+        std::size_t size = getSizeMat();
+        const std::string pathName(m_command.next());
+
+        const std::string outputName = pathName + ".out";
+        const auto inputCount = static_cast<std::size_t>(m_snapshot->evaluated[index]->inputCount());
+        BatchReport report;
+
+        if (MatrixFile::isMatrixFile(pathName))
+        {
+            const MatrixFile input = openMatrixFile(pathName, size);
+            if (input.count() % inputCount != 0)
+            {
+                throw std::runtime_error("The file ends in the middle of input set #" +
+                                         std::to_string(input.count() / inputCount + 1) + ".");
+            }
+            MatrixFile output(outputName, size, input.count() / inputCount, true);
+            report = batchWith(index, size, [&](const auto& blank, auto makeEvaluator)
+            {
+                return runBatch(input, output, blank, inputCount, makeEvaluator);
+            });
+        }
+        else
+        {
+            std::ifstream input(pathName);
+            if (!input.is_open())
+                throw FileException("Failed to open the file.");
+            std::ofstream output(outputName);
+            if (!output.is_open())
+                throw FileException("Failed to create the file " + outputName + ".");
+            report = batchWith(index, size, [&](const auto& blank, auto makeEvaluator)
+            {
+                return runBatch(input, output, blank, inputCount, makeEvaluator);
+            });
+        }
+
+        const double rate = report.seconds > 0 ? static_cast<double>(report.sets) / report.seconds : 0;
+        m_ostr << "\nEvaluated " << report.sets << " input sets (" << report.outOfRange
+               << " out of range) in " << report.seconds << " s: " << rate << " sets/sec.\n"
+               << "The results are in " << outputName << '\n';
+    }
+    catch (const std::runtime_error& e)
+    {
+        throwError<std::runtime_error>(e.what());
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Returns run(blank, makeEvaluator) for the evaluator that suits 'size':
+// stack matrices of a fixed size, or the cached plan of the operation.
+// The operation is looked up and planned once for the whole batch, and
+// every shard of the batch gets an evaluator of its own.
+template <typename Run>
+BatchReport FunctionCalculator::batchWith(std::size_t index, std::size_t size, Run run)
+{
+    const auto& evaluated = *m_snapshot->evaluated[index];
+    BatchReport report;
+
+    const bool fixed = dispatchFixedSize(size, [&]<std::size_t N>()
+    {
+        using Matrix = FixedSquareMatrix<int, N>;
+        report = run(Matrix(), [&evaluated]
+        {
+            return [&evaluated](std::span<const Matrix> set)
+            {
+                return FixedEvaluator<N>().evaluate(evaluated, set);
+            };
+        });
+    });
+    if (fixed)
+        return report;
+
+    const EvalPlan& plan = getPlan(m_snapshot->evaluated[index], size);
+    return run(Operation::T(size, Operation::T::Uninitialized{}), [&plan]
+    {
+        return [&plan, workspace = EvalPlan::Workspace()](std::span<const Operation::T> set)
+            mutable -> const Operation::T&
+        {
+            return plan.run(set, workspace);
+        };
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+// convert n source target: nxn matrices as text (as eval reads them) are
+// written to the matrix file 'target', and a matrix file is written back as
+// text (in the format of evalbatch results)
+void FunctionCalculator::convert()
+{
+    try
+    {
+        validNumOfArguments(THREE_ARGS);
+        if (m_options.elementType != ElementType::Int)
+            throw OperationExceptionRange("convert works on int matrices only.");
+        std::size_t size = getSizeMat();
+        const std::string sourceName(m_command.next());
+        const std::string targetName(m_command.next());
+
+        if (MatrixFile::isMatrixFile(sourceName))
+        {
+            const MatrixFile source = openMatrixFile(sourceName, size);
+            std::ofstream target(targetName);
+            if (!target.is_open())
+                throw FileException("Failed to create the file " + targetName + ".");
+            writeMatrixText(source, target);
+            m_ostr << "\nConverted " << source.count() << " matrices to text in " << targetName << '\n';
+        }
+        else
+        {
+            std::ifstream source(sourceName);
+            if (!source.is_open())
+                throw FileException("Failed to open the file.");
+            const std::size_t count = writeMatrixFile(source, targetName, size);
+            m_ostr << "\nConverted " << count << " matrices to the matrix file " << targetName << '\n';
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        throwError<std::runtime_error>(e.what());
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFile FunctionCalculator::openMatrixFile(const std::string& pathName, std::size_t size) const
+{
+    MatrixFile file(pathName);
+    if (file.size() != size)
+    {
+        throw std::runtime_error("The matrices in " + pathName + " are " + std::to_string(file.size()) +
+                                 "x" + std::to_string(file.size()) + ", not " + std::to_string(size) +
+                                 "x" + std::to_string(size) + ".");
+    }
+    return file;
+}
+
+//-----------------------------------------------------------------------------
+
+const EvalPlan& FunctionCalculator::getPlan(const std::shared_ptr<Operation>& evaluated,
+                                            std::size_t size)
+{
+    auto key = std::make_pair(evaluated, size);
+    auto plan = m_plans.find(key);
+    if (plan == m_plans.end())
+        plan = m_plans.emplace(std::move(key), EvalPlan(*evaluated, size)).first;
+    return plan->second;
+}
+
+//-----------------------------------------------------------------------------
+
 void FunctionCalculator::printNumMat(int inputCount) const
 {
     if (inputCount > 1)
@@ -109,32 +581,27 @@ void FunctionCalculator::printNumMat(int inputCount) const
 
 //-----------------------------------------------------------------------------
 
-int FunctionCalculator::getSizeMat()
+std::size_t FunctionCalculator::getSizeMat()
 {
     int size;
     validDigit(size);
 
-    if (size < 1 || size > MAX_MAT_SIZE)
+    if (size < 1 || static_cast<std::size_t>(size) > m_options.maxMatSize)
     {
         throw OperationExceptionRange
-            ("Invalid size. Please size in the range of (1 - 5).");
+            ("Invalid size. Please size in the range of (1 - " +
+             std::to_string(m_options.maxMatSize) + ").");
     }
-    return size;
+    return static_cast<std::size_t>(size);
 }
 
 //-----------------------------------------------------------------------------
 
+// The arguments are the tokens of the line after the command
 void FunctionCalculator::validNumOfArguments(int wanted) const
 {
-    std::string arguments;
-	std::istringstream tempIss(m_iss.str());
-
-	int counterArguments = -1;
-    while (tempIss >> arguments)
-    {
-        ++counterArguments;
-        compare(counterArguments > wanted);
-    }
+	const int counterArguments = static_cast<int>(m_command.size()) - 1;
+    compare(counterArguments > wanted);
     compare(counterArguments < wanted);
 }
 
@@ -151,11 +618,69 @@ void FunctionCalculator::compare(bool valid) const
 
 //-----------------------------------------------------------------------------
 
+// Deletes the operation this session knows as #i, wherever another session's
+// changes have moved it since
 void FunctionCalculator::del()
 {
     validNumOfArguments(ONE_ARGS);
-    int i = readOperationIndex();
-    m_operations.erase(m_operations.begin() + i);
+    const std::size_t i = readOperationIndex();
+    const auto operation = m_snapshot->operations[i];
+
+    commit([&](Snapshot& next)
+    {
+        const auto found = std::ranges::find(next.operations, operation);
+        if (found == next.operations.end())
+            throw OperationExceptionDigit("Operation #" + std::to_string(i) +
+                                          " was already deleted by another session.");
+
+        next.evaluated.erase(next.evaluated.begin() + (found - next.operations.begin()));
+        next.operations.erase(found);
+    });
+    m_pool.release();
+}
+
+//-----------------------------------------------------------------------------
+
+// The operation counts are of this session's snapshot; the node and matrix
+// totals are of every session
+void FunctionCalculator::stats()
+{
+    const bool json = m_command.size() > ONE_ARGS;
+    validNumOfArguments(json ? ONE_ARGS : ZERO_ARGS);
+    if (json && m_command.next() != JSON_FLAG)
+        throw OperationExceptionRange("Unknown stats option. The option of stats is --json.");
+
+    const auto usage = OperationRegistry::usage(*m_snapshot);
+    const auto nodes = MemoryStats::totals(MemoryKind::Operation);
+    const auto matrices = MemoryStats::totals(MemoryKind::Matrix);
+
+    if (json)
+    {
+        m_ostr << "{\"operations\": " << m_snapshot->operations.size()
+               << ", \"max_operations\": " << m_snapshot->maxOperations
+               << ", \"version\": " << m_snapshot->version
+               << ", \"unique_nodes\": " << usage.uniqueNodes
+               << ", \"shared_nodes\": " << usage.sharedNodes
+               << ", \"registry_bytes\": " << usage.bytes
+               << ", \"node_bytes\": " << nodes.liveBytes
+               << ", \"node_allocations\": " << nodes.allocations
+               << ", \"node_deallocations\": " << nodes.deallocations
+               << ", \"matrix_bytes\": " << matrices.liveBytes
+               << ", \"matrix_allocations\": " << matrices.allocations
+               << ", \"matrix_deallocations\": " << matrices.deallocations
+               << ", \"last_eval_peak_bytes\": " << m_lastEvalPeakBytes << "}\n";
+        return;
+    }
+
+    m_ostr << "Operations: " << m_snapshot->operations.size() << " of "
+           << m_snapshot->maxOperations << " (version " << m_snapshot->version << ")\n"
+           << "Nodes: " << usage.uniqueNodes << " unique, " << usage.sharedNodes << " shared, "
+           << usage.bytes << " bytes held by the operation list\n"
+           << "Operation nodes of all sessions: " << nodes.liveBytes << " bytes; "
+           << nodes.allocations << " allocations, " << nodes.deallocations << " deallocations\n"
+           << "Matrices of all sessions: " << matrices.liveBytes << " bytes; "
+           << matrices.allocations << " allocations, " << matrices.deallocations << " deallocations\n"
+           << "Peak bytes of matrices during the last eval: " << m_lastEvalPeakBytes << "\n";
 }
 
 //-----------------------------------------------------------------------------
@@ -164,7 +689,7 @@ void FunctionCalculator::help() const
 {
     validNumOfArguments(ZERO_ARGS);
     m_ostr << "The available commands are:\n";
-    for (const auto& action : m_actions)
+    for (const auto& action : ACTIONS)
     {
         m_ostr << "* " << action.command << action.description << '\n';
     }
@@ -190,17 +715,21 @@ void FunctionCalculator::getMaxOperation()
         try
         {
             m_ostr << "Enter the maximum number of operations: ";
-			m_istr >> maxValue;
-            m_iss.str(maxValue);
-
-            m_maxOperation = getNumber();
+			if (!(m_istr >> maxValue))
+            {
+                m_running = false;
+                return;
+            }
+            m_command.assign(maxValue);
+
+            const int value = getNumber();
+            commit([value](Snapshot& next) { next.maxOperations = value; });
             break;
         }
         catch (const std::exception& e)
         {
             std::cerr << "Error: " << e.what() << '\n';
         }
-		m_iss.clear();
     }
 }
 
@@ -211,7 +740,7 @@ int FunctionCalculator::getNumber()
     int value;
     validDigit(value);
 
-	if (value < 2 || value > 100)
+	if (value < MIN_OPERATION_LIMIT || value > MAX_OPERATION_LIMIT)
 	{
 		throwError<std::out_of_range>
 			("Number is out of the valid range (2-100).");
@@ -223,11 +752,16 @@ int FunctionCalculator::getNumber()
 
 void FunctionCalculator::validDigit(int& value)
 {
-    std::string input;
+    const std::string_view input = m_command.next();
+    const char* end = input.data() + input.size();
+    const auto [parsed, error] = std::from_chars(input.data(), end, value);
+    if (error == std::errc() && parsed == end)
+        return;
+
+    // A token from_chars rejects goes through std::stoi, for the errors (and
+    // the "+5" form) that the commands always had
     std::size_t pos;
-
-    m_iss >> input;
-    value = std::stoi(input, &pos);
+    value = std::stoi(std::string(input), &pos);
 
     if (pos != input.size())
     {
@@ -242,11 +776,12 @@ void FunctionCalculator::printOperations() const
     m_ostr << "============================================================" <<
               "==================\n\n";
     m_ostr << "List of available matrix operations with the limit of - '" << 
-       m_maxOperation << "' matrixes as input:\n";
-    for (decltype(m_operations.size()) i = 0; i < m_operations.size(); ++i)
+       m_snapshot->maxOperations << "' matrixes as input:\n";
+    const auto& operations = m_snapshot->operations;
+    for (decltype(operations.size()) i = 0; i < operations.size(); ++i)
     {
         m_ostr << i << ". ";
-        m_operations[i]->print(m_ostr,true);
+        operations[i]->print(m_ostr,true);
         m_ostr << '\n';
     }
     m_ostr << '\n';
@@ -256,50 +791,44 @@ void FunctionCalculator::printOperations() const
 
 void FunctionCalculator::getUserCommand()
 {
-    std::string input;
-    while (true)
+    while (!m_command.readLine(m_istr))
     {
-	    std::getline(m_istr, input);
-        if (!input.empty()) break;
+        // The input is over (for a session, the client went away)
+        if (!m_istr)
+        {
+            m_running = false;
+            return;
+        }
     }
-
-	m_iss.clear();
-	m_iss.str(input);
 }
 
 //-----------------------------------------------------------------------------
 
-int FunctionCalculator::readOperationIndex()
+std::size_t FunctionCalculator::readOperationIndex()
 {
     int i = 0;
     validDigit(i);
 
 	if (i < 0 ||
-        i >= static_cast<int>(m_operations.size()))
+        i >= static_cast<int>(m_snapshot->operations.size()))
 	{
         throw OperationExceptionDigit("Invalid input. Please enter a valid operation index.");
 	}
-    return i;
+    return static_cast<std::size_t>(i);
 }
 
 //-----------------------------------------------------------------------------
 
 Action FunctionCalculator::readAction()
 {
-    std::string action;
-    if (!(m_iss >> action))
-    {
-		throwError<std::runtime_error>("Command not found\n");
-    }
-
-    const auto i = std::ranges::find(m_actions, action, &ActionDetails::command);
+    const auto i = ACTION_HASH.find(m_command.next());
 
-	if (i == m_actions.end())
+	if (i == ACTIONS.size())
 	{
         throwError<std::runtime_error>("Command not found\n");
 	}
     
-    return i->action;
+    return ACTIONS[i].action;
 }
 
 //-----------------------------------------------------------------------------
@@ -315,10 +844,15 @@ void FunctionCalculator::runAction(Action action)
                 break;
 
             case Action::Eval:         eval();                     break;
+            case Action::Profile:      eval(true);                 break;
+            case Action::EvalBatch:    evalBatch();                break;
+            case Action::Convert:      convert();                  break;
             case Action::Add:          binaryFunc<Add>();          break;
             case Action::Sub:          binaryFunc<Sub>();          break;
+            case Action::Mul:          binaryFunc<Mul>();          break;
             case Action::Comp:         binaryFunc<Comp>();         break;
             case Action::Del:          del();                      break;
+            case Action::Stats:        stats();                    break;
             case Action::Help:         help();                     break;
             case Action::Exit:         exit();                     break;
 			case Action::Resize:       resizeMaxOperations();      break;
@@ -348,13 +882,41 @@ void FunctionCalculator::runAction(Action action)
 
 void FunctionCalculator::read()
 {
-    std::string pathName;
-    m_iss.get(); // avoid the spacebar
-    std::getline(m_iss, pathName);
+    // The path is the rest of the line, after the space
+    const std::string pathName(m_command.afterFirst());
     m_currInput = Action::Read; // update we are reading from a file
 
-    auto r = Read(this, pathName);
-    r.readFile();
+    auto r = Read(this, pathName, m_istr, m_ostr, m_options.scriptPolicy);
+
+    // A script that reads one of the scripts running it would never end
+    std::error_code error;
+    const auto canonical = std::filesystem::weakly_canonical(pathName, error);
+    const std::string script = error ? pathName : canonical.string();
+    const auto running = std::ranges::find(m_scripts, script);
+    if (running != m_scripts.end())
+    {
+        std::string cycle;
+        for (auto i = running; i != m_scripts.end(); ++i)
+            cycle += *i + " -> ";
+        throwError<std::runtime_error>("The scripts read each other in a cycle: " + cycle + script);
+    }
+
+    m_scripts.push_back(script);
+    bool completed;
+    try
+    {
+        completed = r.readFile();
+    }
+    catch (...)
+    {
+        m_scripts.pop_back();
+        throw;
+    }
+    m_scripts.pop_back();
+
+    // An aborted script aborts the scripts that read it
+    if (!completed && m_options.scriptPolicy == ScriptPolicy::Abort && !m_scripts.empty())
+        throwError<std::runtime_error>("The script " + pathName + " was aborted.");
 }
 
 //-----------------------------------------------------------------------------
@@ -364,7 +926,7 @@ void FunctionCalculator::resizeMaxOperations()
     validNumOfArguments(ONE_ARGS);
 	int value = getNumber();
 
-    if (value < m_operations.size())
+    if (static_cast<std::size_t>(value) < m_snapshot->operations.size())
     {
 		m_ostr << "\nYou are trying to resize to the number : " << value << 
             ". The number is under the the amount of the current operations.\n" << 
@@ -385,7 +947,7 @@ void FunctionCalculator::evalCommandResize(int value)
     do
     {
 	    std::string command;
-	    m_istr >> command;
+	    if (!(m_istr >> command)) break;
         m_ostr << '\n';
 	    if (command == "cancel") break;
 
@@ -406,21 +968,21 @@ void FunctionCalculator::evalCommandResize(int value)
 
 bool FunctionCalculator::startDel(int value)
 {
+    const auto limit = static_cast<std::size_t>(value);
     printOperations();
-    m_ostr << "You need to erase " << m_operations.size() - value <<
+    m_ostr << "You need to erase " << m_snapshot->operations.size() - limit <<
         " more operations:";
     m_ostr << "\nDelete operation #";
 
-    m_iss.clear();
     std::string index;
     m_istr >> index;
     m_ostr << '\n';
-    m_iss.str("del " + index);
-    m_iss >> index; // To delete "del" for the .str()
+    m_command.assign("del " + index);
+    m_command.next(); // To skip "del"
 
     del();
 
-    if (m_operations.size() <= value) return true;
+    if (m_snapshot->operations.size() <= limit) return true;
     return false;
 }
 
@@ -428,82 +990,57 @@ bool FunctionCalculator::startDel(int value)
 
 void FunctionCalculator::changeMaxOperation(int value)
 {
-	m_maxOperation = value;
+    commit([&](Snapshot& next)
+    {
+        if (next.operations.size() > static_cast<std::size_t>(value))
+            throw OperationExceptionRange("Another session added operations: there are " +
+                                          std::to_string(next.operations.size()) +
+                                          " operations now, more than " + std::to_string(value) + ".");
+        next.maxOperations = value;
+    });
 	m_ostr << "The maximum number of operations is now: " 
-           << m_maxOperation << '\n';
+           << m_snapshot->maxOperations << '\n';
 }
 
 //-----------------------------------------------------------------------------
 
-FunctionCalculator::ActionMap FunctionCalculator::createActions() const
+// 'evaluated' is 'operation' built on the evaluated forms of its operands
+void FunctionCalculator::addOperation(const std::shared_ptr<Operation>& operation,
+                                      const std::shared_ptr<Operation>& evaluated)
 {
-    return ActionMap
+    const auto simplified = m_options.simplify
+                                ? Simplifier(m_options.rangePolicy).simplify(evaluated)
+                                : operation;
+
+    // The limit is checked again on the latest version, which another
+    // session may have filled up
+    commit([&](Snapshot& next)
     {
-        {
-            "eval",
-            "(uate) num n - compute the result of function #num on an nxn matrix "
-			"(that will be prompted)",
-            Action::Eval
-        },
-        {
-            "scal",
-            "(ar) val - creates an operation that multiplies the "
-			"given matrix by scalar val",
-            Action::Scal
-        },
-        {
-            "add",
-            " num1 num2 - creates an operation that is the addition of the result "
-			"of operation #num1 and the result of operation #num2",
-            Action::Add
-        },
-         {
-            "sub",
-            " num1 num2 - creates an operation that is the subtraction of the result "
-			"of operation #num1 and the result of operation #num2",
-            Action::Sub
-        },
-        {
-            "comp",
-            "(osite) num1 num2 - creates an operation that is the composition of "
-			"operation #num1 and operation #num2",
-            Action::Comp
-        },
-        {
-            "del",
-            "(ete) num - delete operation #num from the operation list",
-            Action::Del
-		},
-		{
-			"resize",
-			" num - resize the maximum number of operations to num (2 <= num <= 100)",
-			Action::Resize
-		},
-        {
-            "read",
-            " pathFile - execute operations from a file",
-            Action::Read
-        },
-        {
-            "help",
-            " - print this command list",
-            Action::Help
-        },
-        {
-            "exit",
-            " - exit the program",
-            Action::Exit
-        }
-    };
+        checkOperationLimit(next);
+        next.operations.push_back(operation);
+        next.evaluated.push_back(simplified);
+    });
 }
 
 //-----------------------------------------------------------------------------
 
-FunctionCalculator::OperationList FunctionCalculator::createOperations() const
+void FunctionCalculator::checkOperationLimit(const Snapshot& snapshot) const
 {
-    return OperationList
+    if (snapshot.operations.size() >= static_cast<std::size_t>(snapshot.maxOperations))
     {
-        std::make_shared<Identity>(),
-        std::make_shared<Transpose>(),
-    };
+        throwError<std::out_of_range>("You have exceeded the limits of the number"
+            " of the operations! Returning...\n");
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// A plan whose operation no snapshot of this session holds any more can never
+// be used again
+void FunctionCalculator::setSnapshot(std::shared_ptr<const Snapshot> snapshot)
+{
+    const bool changed = snapshot->version != m_snapshot->version;
+    m_snapshot = std::move(snapshot);
+    if (changed)
+        std::erase_if(m_plans, [](const auto& plan) { return plan.first.first.use_count() == 1; });
 }
\ No newline at end of file
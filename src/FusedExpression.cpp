@@ -0,0 +1,419 @@
+#include "FusedExpression.h"
+#include "OperationVisitor.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "Mul.h"
+#include "Comp.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+
+//-----------------------------------------------------------------------------
+
+// Builds the expression tree with one visit per operation node.
+// A Comp passes the tree of its first operation as the first input ("head")
+// of its second operation, so the second tree reads it without a temporary.
+class FusedExpression::Compiler : public OperationVisitor
+{
+public:
+    static const std::size_t NONE = SIZE_MAX;
+
+    struct Node
+    {
+        OpCode code;
+        std::size_t source = 0;
+        bool transposed = false;
+        int scalar = 0;
+        std::size_t left = NONE;
+        std::size_t right = NONE;
+    };
+
+    // Returns the root node of 'operation' or NONE when it cannot be fused
+    std::size_t build(const Operation& operation, std::size_t offset, std::size_t head);
+    std::size_t emit(std::size_t node, FusedExpression& expression) const;
+
+    void visit(const Identity& operation) override;
+    void visit(const Transpose& operation) override;
+    void visit(const Scalar& operation) override;
+    void visit(const Add& operation) override;
+    void visit(const Sub& operation) override;
+    void visit(const Mul& operation) override;
+    void visit(const Comp& operation) override;
+
+    std::vector<Node> m_nodes;
+    std::vector<Source> m_sources;
+
+private:
+    std::size_t input();
+    std::size_t leaf(const Source& source);
+    std::size_t transposed(std::size_t node);
+    void binary(const BinaryOperation& operation, OpCode code);
+    std::size_t offsetOfSecond(const BinaryOperation& operation) const;
+
+    std::size_t m_offset = 0;
+    std::size_t m_head = NONE;
+    std::size_t m_result = NONE;
+};
+
+//-----------------------------------------------------------------------------
+
+std::size_t FusedExpression::Compiler::build(const Operation& operation, std::size_t offset,
+                                             std::size_t head)
+{
+    m_offset = offset;
+    m_head = head;
+    operation.accept(*this);
+    return m_result;
+}
+
+//-----------------------------------------------------------------------------
+
+// Offset of the first input of operation.second(), when 'operation' is visited
+std::size_t FusedExpression::Compiler::offsetOfSecond(const BinaryOperation& operation) const
+{
+    return m_offset + operation.secondOffset() - (m_head != NONE ? 1 : 0);
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t FusedExpression::Compiler::leaf(const Source& source)
+{
+    m_sources.push_back(source);
+    m_nodes.push_back({ .code = OpCode::Load, .source = m_sources.size() - 1 });
+    return m_nodes.size() - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+// The first input of the node being visited
+std::size_t FusedExpression::Compiler::input()
+{
+    return m_head != NONE ? m_head : leaf({ .offset = m_offset });
+}
+
+//-----------------------------------------------------------------------------
+
+// A copy of the tree of 'node' that reads every one of its inputs transposed
+std::size_t FusedExpression::Compiler::transposed(std::size_t node)
+{
+    Node copy = m_nodes[node];
+    if (copy.code == OpCode::Load)
+        copy.transposed = !copy.transposed;
+    if (copy.left != NONE)
+        copy.left = transposed(copy.left);
+    if (copy.right != NONE)
+        copy.right = transposed(copy.right);
+
+    m_nodes.push_back(copy);
+    return m_nodes.size() - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Identity& operation)
+{
+    (void)operation;
+    m_result = input();
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Transpose& operation)
+{
+    (void)operation;
+    m_result = transposed(input());
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Scalar& operation)
+{
+    const std::size_t child = input();
+    m_nodes.push_back({ .code = OpCode::Scale, .scalar = operation.scalar(), .left = child });
+    m_result = m_nodes.size() - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::binary(const BinaryOperation& operation, OpCode code)
+{
+    const std::size_t secondOffset = offsetOfSecond(operation);
+    const std::size_t left = build(*operation.first(), m_offset, m_head);
+    if (left == NONE)
+        return;
+
+    const std::size_t right = build(*operation.second(), secondOffset, NONE);
+    if (right == NONE)
+        return;
+
+    m_nodes.push_back({ .code = code, .left = left, .right = right });
+    m_result = m_nodes.size() - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Add& operation)
+{
+    binary(operation, OpCode::Add);
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Sub& operation)
+{
+    binary(operation, OpCode::Sub);
+}
+
+//-----------------------------------------------------------------------------
+
+// A product is computed on its own and read as an input - unless it gets
+// its first input from a Comp, which then cannot be fused either
+void FusedExpression::Compiler::visit(const Mul& operation)
+{
+    m_result = m_head != NONE ? NONE : leaf({ .opaque = &operation, .offset = m_offset });
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::Compiler::visit(const Comp& operation)
+{
+    const std::size_t offset = m_offset, head = m_head;
+    const std::size_t nodeCount = m_nodes.size(), sourceCount = m_sources.size();
+
+    const std::size_t secondOffset = offsetOfSecond(operation);
+    const std::size_t first = build(*operation.first(), offset, head);
+    m_result = first == NONE ? NONE : build(*operation.second(), secondOffset, first);
+
+    // Not fusable as a whole: computed on its own, like a Mul
+    if (m_result == NONE && head == NONE)
+    {
+        m_nodes.resize(nodeCount);
+        m_sources.resize(sourceCount);
+        m_result = leaf({ .opaque = &operation, .offset = offset });
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Appends the postfix program of 'node'; returns the stack depth it needs
+std::size_t FusedExpression::Compiler::emit(std::size_t node, FusedExpression& expression) const
+{
+    const Node& current = m_nodes[node];
+    std::size_t depth = 1;
+
+    if (current.left != NONE)
+        depth = emit(current.left, expression);
+    if (current.right != NONE)
+        depth = std::max(depth, emit(current.right, expression) + 1);
+    if (current.transposed)
+        expression.m_transposes = true;
+
+    expression.m_program.push_back({ current.code, current.source, current.transposed,
+                                     current.scalar });
+    return depth;
+}
+
+//-----------------------------------------------------------------------------
+
+std::optional<FusedExpression> FusedExpression::compile(const Operation& root)
+{
+    Compiler compiler;
+    const std::size_t node = compiler.build(root, 0, Compiler::NONE);
+
+    // The root itself was left to its own compute()
+    if (node == Compiler::NONE || compiler.m_sources[compiler.m_nodes[node].source].opaque == &root)
+        return std::nullopt;
+
+    FusedExpression expression;
+    expression.m_depth = compiler.emit(node, expression);
+    expression.m_sources = std::move(compiler.m_sources);
+    return expression;
+}
+
+//-----------------------------------------------------------------------------
+
+Operation::T FusedExpression::evaluate(Operation::Inputs input) const
+{
+    // The nodes that are not fused are computed first. They are independent
+    // of each other, so on large matrices they are computed in parallel.
+    std::vector<std::optional<T>> opaqueResults(m_sources.size());
+    const auto computeSource = [&](std::size_t i)
+    {
+        if (m_sources[i].opaque)
+            opaqueResults[i].emplace(m_sources[i].opaque->evaluate(input.subspan(m_sources[i].offset)));
+    };
+
+    const std::size_t size = input.front().size();
+    if (size * size >= PARALLEL_MIN_WORK)
+        ThreadPool::instance().parallelFor(m_sources.size(), computeSource);
+    else
+    {
+        for (std::size_t i = 0; i < m_sources.size(); ++i)
+            computeSource(i);
+    }
+
+    std::vector<const T*> sources;
+    sources.reserve(m_sources.size());
+    for (std::size_t i = 0; i < m_sources.size(); ++i)
+    {
+        sources.push_back(opaqueResults[i] ? &*opaqueResults[i] : &input[m_sources[i].offset]);
+    }
+
+    // Every source is a size x size matrix, like the inputs
+    T result(size, T::Uninitialized{});
+    run(sources, result);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+
+void FusedExpression::run(std::span<const T* const> sources, T& result) const
+{
+    if (m_transposes)
+        evaluateBlocked(sources, result);
+    else
+        evaluateFlat(sources, result);
+}
+
+//-----------------------------------------------------------------------------
+
+// Runs the program on one tile of 'count' elements and writes the result to
+// 'output'. load(instruction, slot) returns the elements a Load pushes; slot
+// is scratch space for them.
+template <typename Load>
+bool FusedExpression::runTile(Load load, std::size_t count, int* output) const
+{
+    thread_local std::vector<const int*> stack;
+    thread_local std::vector<int, AlignedAllocator<int, MATRIX_ALIGNMENT>> scratch;
+    stack.resize(m_depth);
+    scratch.resize(m_depth * FUSED_TILE);
+
+    const int low = T::lowBound<int>(), high = T::highBound<int>();
+    const RangePolicy policy = T::rangePolicy();
+    std::size_t top = 0;
+
+    for (std::size_t i = 0; i < m_program.size(); ++i)
+    {
+        const Instruction& instruction = m_program[i];
+
+        if (instruction.code == OpCode::Load)
+        {
+            stack[top] = load(instruction, scratch.data() + top * FUSED_TILE);
+            ++top;
+            continue;
+        }
+
+        if (instruction.code != OpCode::Scale)
+            --top;
+
+        // The last instruction writes the result, the others the scratch
+        // tile of the stack slot they leave their result in
+        int* dst = i + 1 == m_program.size() ? output : scratch.data() + (top - 1) * FUSED_TILE;
+        bool inRange;
+        switch (instruction.code)
+        {
+        case OpCode::Scale:
+            inRange = MatrixKernels::scale(dst, stack[top - 1], instruction.scalar, count, low, high, policy);
+            break;
+        case OpCode::Add:
+            inRange = MatrixKernels::add(dst, stack[top - 1], stack[top], count, low, high, policy);
+            break;
+        default:
+            inRange = MatrixKernels::sub(dst, stack[top - 1], stack[top], count, low, high, policy);
+            break;
+        }
+
+        if (!inRange)
+            return false;
+        stack[top - 1] = dst;
+    }
+
+    // A lone Load (a Comp of identities) still has to be copied
+    if (stack[0] != output)
+        std::copy_n(stack[0], count, output);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+// Without transposes all the buffers share one layout, so they are walked as
+// flat arrays (row padding included, it stays zero).
+// The tiles are independent; every task runs a range of them.
+void FusedExpression::evaluateFlat(std::span<const T* const> sources, T& result) const
+{
+    const std::size_t count = result.size() * result.stride();
+    const std::size_t tiles = (count + FUSED_TILE - 1) / FUSED_TILE;
+    ThreadPool& pool = ThreadPool::instance();
+    const std::size_t tasks = std::min(tiles, pool.taskCount(count * m_program.size()));
+
+    pool.parallelFor(tasks, [&](std::size_t task)
+    {
+        for (std::size_t tile = tiles * task / tasks; tile < tiles * (task + 1) / tasks; ++tile)
+        {
+            const std::size_t begin = tile * FUSED_TILE;
+            const auto load = [&](const Instruction& instruction, int*)
+            {
+                return sources[instruction.source]->data() + begin;
+            };
+
+            if (!runTile(load, std::min(FUSED_TILE, count - begin), result.data() + begin))
+                T::rangeError();
+        }
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+// With transposes the result is computed in square blocks, so a transposed
+// input is read a block at a time too. Every task runs a range of block rows.
+void FusedExpression::evaluateBlocked(std::span<const T* const> sources, T& result) const
+{
+    const std::size_t size = result.size();
+    const std::size_t bands = (size + FUSED_BLOCK - 1) / FUSED_BLOCK;
+    ThreadPool& pool = ThreadPool::instance();
+    const std::size_t tasks = std::min(bands, pool.taskCount(size * size * m_program.size()));
+
+    pool.parallelFor(tasks, [&](std::size_t task)
+    {
+        thread_local std::vector<int, AlignedAllocator<int, MATRIX_ALIGNMENT>> block;
+        block.resize(FUSED_BLOCK * FUSED_BLOCK);
+
+        for (std::size_t band = bands * task / tasks; band < bands * (task + 1) / tasks; ++band)
+        {
+            const std::size_t row = band * FUSED_BLOCK;
+            const std::size_t rows = std::min(FUSED_BLOCK, size - row);
+            for (std::size_t col = 0; col < size; col += FUSED_BLOCK)
+            {
+                const std::size_t cols = std::min(FUSED_BLOCK, size - col);
+
+                const auto load = [&](const Instruction& instruction, int* slot) -> const int*
+                {
+                    const T& source = *sources[instruction.source];
+                    if (instruction.transposed)
+                    {
+                        transposeBlocked(source.subview(col, row, cols, rows),
+                                         MatrixView<int>(slot, rows, cols, cols));
+                        return slot;
+                    }
+                    for (std::size_t i = 0; i < rows; ++i)
+                    {
+                        std::copy_n(source.row(row + i).data() + col, cols, slot + i * cols);
+                    }
+                    return slot;
+                };
+
+                if (!runTile(load, rows * cols, block.data()))
+                    T::rangeError();
+
+                for (std::size_t i = 0; i < rows; ++i)
+                {
+                    std::copy_n(block.data() + i * cols, cols, result.row(row + i).data() + col);
+                }
+            }
+        }
+    });
+}
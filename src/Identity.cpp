@@ -1,10 +1,13 @@
 #include "Identity.h"
 #include <iostream>
+#include <utility>
 
 //-----------------------------------------------------------------------------
 
-Operation::T Identity::compute(const std::vector<T>& input) const
+Operation::T Identity::compute(Inputs input) const
 {
+    if (T* const owned = input.ownedFront())
+        return std::move(*owned);
     return input.front();
 }
 
@@ -14,4 +17,11 @@ void Identity::print(std::ostream& ostr, bool first_print) const
 {
     (void)first_print; // Cast to void to avoid unused parameter warning
     ostr << "id";
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+
+void Identity::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
@@ -0,0 +1,199 @@
+#include "IntegerReader.h"
+#include "Utility.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+namespace
+{
+    // The get area of a stream buffer, read in place. Its accessors are
+    // protected, but a class derived from std::streambuf may take their
+    // addresses, and a pointer to a member works on any stream buffer.
+    struct GetArea : std::streambuf
+    {
+        // The buffered characters not read yet (none for an unbuffered stream)
+        static std::string_view view(std::streambuf& buffer)
+        {
+            const char* next = (buffer.*&GetArea::gptr)();
+            return std::string_view(next, static_cast<std::size_t>((buffer.*&GetArea::egptr)() - next));
+        }
+
+        static void consume(std::streambuf& buffer, std::size_t count)
+        {
+            (buffer.*&GetArea::gbump)(static_cast<int>(count));
+        }
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+IntegerReader::IntegerReader(std::istream& istr) : m_istr(istr), m_buffer(istr.rdbuf())
+{
+    if (m_istr.tie())
+        m_istr.tie()->flush();
+}
+
+//-----------------------------------------------------------------------------
+
+bool IntegerReader::isSpace(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+//-----------------------------------------------------------------------------
+
+void IntegerReader::rangeError()
+{
+    throw std::out_of_range(RANGE_ERROR_MESSAGE);
+}
+
+//-----------------------------------------------------------------------------
+
+int IntegerReader::parseSlow(const std::string& token)
+{
+    std::size_t pos;
+    int value = std::stoi(token, &pos);
+
+    if (pos != token.size())
+    {
+        throw std::out_of_range("Input is not a valid number.");
+    }
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+int IntegerReader::next()
+{
+    using Traits = std::char_traits<char>;
+
+    // A stream that is not good() reads nothing, like a failed sentry
+    if (!m_istr.good() || !m_buffer)
+    {
+        m_istr.setstate(std::ios::failbit);
+        return parseSlow("");
+    }
+
+    // Whitespace is skipped a buffered run at a time
+    for (;;)
+    {
+        const std::string_view buffered = GetArea::view(*m_buffer);
+        std::size_t spaces = 0;
+        while (spaces < buffered.size() && isSpace(buffered[spaces]))
+            ++spaces;
+        GetArea::consume(*m_buffer, spaces);
+        if (spaces < buffered.size())
+            break;
+
+        // Refills the buffer, or peeks at a stream that does not buffer
+        const int c = m_buffer->sgetc();
+        if (c == Traits::eof())
+        {
+            m_istr.setstate(std::ios::eofbit | std::ios::failbit);
+            return parseSlow("");
+        }
+        if (!isSpace(c))
+            break;
+        if (GetArea::view(*m_buffer).empty())
+            m_buffer->sbumpc();
+    }
+
+    // A token that ends inside the buffer is parsed in place
+    const std::string_view buffered = GetArea::view(*m_buffer);
+    std::size_t length = 0;
+    while (length < buffered.size() && !isSpace(buffered[length]))
+        ++length;
+    if (length < buffered.size())
+    {
+        int value;
+        const char* begin = buffered.data();
+        const auto [end, error] = std::from_chars(begin, begin + length, value);
+        if (error == std::errc() && end == begin + length)
+        {
+            GetArea::consume(*m_buffer, length);
+            return value;
+        }
+
+        const std::string token(begin, length);
+        GetArea::consume(*m_buffer, length);
+        return parseSlow(token);
+    }
+
+    return nextSplit();
+}
+
+//-----------------------------------------------------------------------------
+
+// A character at a time, for a token that runs past the buffered characters
+int IntegerReader::nextSplit()
+{
+    using Traits = std::char_traits<char>;
+
+    char token[MAX_TOKEN];
+    std::size_t length = 0;
+    std::string longToken;
+    int c = m_buffer->sgetc();
+    while (c != Traits::eof() && !isSpace(c))
+    {
+        if (length < MAX_TOKEN)
+            token[length++] = Traits::to_char_type(c);
+        else
+            longToken += Traits::to_char_type(c);
+        c = m_buffer->snextc();
+    }
+    if (c == Traits::eof())
+        m_istr.setstate(std::ios::eofbit);
+
+    if (longToken.empty())
+    {
+        int value;
+        const auto [end, error] = std::from_chars(token, token + length, value);
+        if (error == std::errc() && end == token + length)
+            return value;
+    }
+    return parseSlow(std::string(token, length) + longToken);
+}
+
+//-----------------------------------------------------------------------------
+
+void IntegerReader::read(std::span<int> values, int low, int high)
+{
+    std::size_t i = 0;
+    while (i < values.size())
+    {
+        // Every value whose token ends inside the buffer is parsed in one
+        // pass over it; anything else - the end of the buffer, a bad token
+        // or a value out of range - is left to next()
+        if (m_istr.good() && m_buffer)
+        {
+            const std::string_view buffered = GetArea::view(*m_buffer);
+            const char* parsed = buffered.data();
+            const char* end = parsed + buffered.size();
+            for (; i < values.size(); ++i)
+            {
+                const char* token = parsed;
+                while (token != end && isSpace(*token))
+                    ++token;
+
+                int value;
+                const auto [stop, error] = std::from_chars(token, end, value);
+                if (error != std::errc() || stop == end || !isSpace(*stop) || value < low || value > high)
+                    break;
+
+                values[i] = value;
+                parsed = stop;
+            }
+            GetArea::consume(*m_buffer, static_cast<std::size_t>(parsed - buffered.data()));
+            if (i == values.size())
+                break;
+        }
+
+        const int input = next();
+        if (input < low || input > high)
+            rangeError();
+
+        values[i++] = input;
+    }
+}
@@ -0,0 +1,176 @@
+#include "MappedFile.h"
+#include "FileException.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+
+MappedFile::MappedFile(const std::string& path)
+{
+    map(path, false);
+}
+
+//-----------------------------------------------------------------------------
+
+MappedFile::MappedFile(const std::string& path, std::size_t size)
+{
+    m_size = size;
+    map(path, true);
+}
+
+//-----------------------------------------------------------------------------
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)),
+#ifdef _WIN32
+      m_file(std::exchange(other.m_file, nullptr)), m_mapping(std::exchange(other.m_mapping, nullptr))
+#else
+      m_file(std::exchange(other.m_file, -1))
+#endif
+{
+}
+
+//-----------------------------------------------------------------------------
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+        m_file = std::exchange(other.m_file, nullptr);
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+#else
+        m_file = std::exchange(other.m_file, -1);
+#endif
+    }
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+// For reading m_size is taken from the file; for writing the mapping
+// extends the new file to m_size bytes, which read as zero
+void MappedFile::map(const std::string& path, bool writable)
+{
+    m_file = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                         FILE_SHARE_READ, nullptr, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+                         FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        m_file = nullptr;
+        throw FileException(writable ? "Failed to create the file " + path + "."
+                                     : "Failed to open the file.");
+    }
+
+    if (!writable)
+    {
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+        {
+            close();
+            throw FileException("Failed to read the file " + path + ".");
+        }
+        m_size = static_cast<std::size_t>(size.QuadPart);
+    }
+    // An empty file cannot be mapped, and there is nothing to map
+    if (m_size == 0)
+        return;
+
+    const auto size = static_cast<unsigned long long>(m_size);
+    m_mapping = CreateFileMappingA(m_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                   static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+    if (m_mapping)
+        m_data = static_cast<std::byte*>(MapViewOfFile(m_mapping,
+                                                       writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+    {
+        close();
+        throw FileException("Failed to map the file " + path + ".");
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void MappedFile::close()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = nullptr;
+}
+
+#else
+
+// For reading m_size is taken from the file; for writing the new file is
+// extended to m_size bytes, which read as zero
+void MappedFile::map(const std::string& path, bool writable)
+{
+    m_file = writable ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                      : ::open(path.c_str(), O_RDONLY);
+    if (m_file < 0)
+    {
+        throw FileException(writable ? "Failed to create the file " + path + "."
+                                     : "Failed to open the file.");
+    }
+
+    struct stat status;
+    const bool sized = writable ? ::ftruncate(m_file, static_cast<off_t>(m_size)) == 0
+                                : ::fstat(m_file, &status) == 0;
+    if (!sized)
+    {
+        close();
+        throw FileException("Failed to size the file " + path + ".");
+    }
+    if (!writable)
+        m_size = static_cast<std::size_t>(status.st_size);
+    // An empty file cannot be mapped, and there is nothing to map
+    if (m_size == 0)
+        return;
+
+    void* data = ::mmap(nullptr, m_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                        writable ? MAP_SHARED : MAP_PRIVATE, m_file, 0);
+    if (data == MAP_FAILED)
+    {
+        close();
+        throw FileException("Failed to map the file " + path + ".");
+    }
+    m_data = static_cast<std::byte*>(data);
+    ::madvise(data, m_size, MADV_SEQUENTIAL);
+}
+
+//-----------------------------------------------------------------------------
+
+void MappedFile::close()
+{
+    if (m_data) ::munmap(m_data, m_size);
+    if (m_file >= 0) ::close(m_file);
+    m_data = nullptr;
+    m_file = -1;
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include "MatrixFile.h"
+#include "SquareMatrix.h"
+#include "BatchEval.h"
+#include "FileException.h"
+#include "MatrixFormatter.h"
+
+#include <bit>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// The elements are read and written in place
+static_assert(std::endian::native == std::endian::little, "matrix files are little-endian");
+
+namespace
+{
+    const char MAGIC[8] = { 'S', 'Q', 'M', 'A', 'T', 'R', 'I', 'X' };
+    const std::uint32_t VERSION = 1;
+    const std::uint32_t INT32_ELEMENTS = 1;
+    const std::uint64_t STATUS_FLAG = 1;
+
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t elementType;
+        std::uint64_t size;
+        std::uint64_t stride;
+        std::uint64_t count;
+        std::uint64_t flags;
+        std::uint8_t reserved[16];
+    };
+    static_assert(sizeof(Header) == 64);
+
+    Header makeHeader(std::size_t size, std::size_t count, bool withStatus)
+    {
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.elementType = INT32_ELEMENTS;
+        header.size = size;
+        header.stride = SquareMatrix<int>::paddedStride(size);
+        header.count = count;
+        header.flags = withStatus ? STATUS_FLAG : 0;
+        return header;
+    }
+
+    [[noreturn]] void invalidFile(const std::string& path, const std::string& reason)
+    {
+        throw FileException("The file " + path + " is not a valid matrix file: " + reason + ".");
+    }
+
+    // Checks that the header of 'file' is valid and that the file holds
+    // everything the header describes
+    Header readHeader(const MappedFile& file, const std::string& path)
+    {
+        Header header;
+        if (file.size() < sizeof(header))
+            invalidFile(path, "it is shorter than the header");
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+            invalidFile(path, "the magic is wrong");
+        if (header.version != VERSION)
+            invalidFile(path, "version " + std::to_string(header.version) + " is not supported");
+        if (header.elementType != INT32_ELEMENTS)
+            invalidFile(path, "element type " + std::to_string(header.elementType) + " is not supported");
+        if (header.size == 0 || header.stride < header.size)
+            invalidFile(path, "the matrix size or stride is wrong");
+
+        // Divisions instead of products, which could overflow
+        const std::uint64_t elements = (file.size() - sizeof(header)) / sizeof(int);
+        const std::uint64_t statusBytes = header.flags & STATUS_FLAG ? header.count : 0;
+        if (header.stride > elements || header.size > elements / header.stride ||
+            header.count > elements / (header.size * header.stride) ||
+            file.size() - sizeof(header) - header.count * header.size * header.stride * sizeof(int)
+                < statusBytes)
+        {
+            invalidFile(path, "it is shorter than its header says");
+        }
+        return header;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixFile::isMatrixFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(MAGIC)] = {};
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFile::MatrixFile(const std::string& path) : m_file(path)
+{
+    const Header header = readHeader(m_file, path);
+    m_size = static_cast<std::size_t>(header.size);
+    m_stride = static_cast<std::size_t>(header.stride);
+    m_count = static_cast<std::size_t>(header.count);
+    layout(header.flags & STATUS_FLAG);
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFile::MatrixFile(const std::string& path, std::size_t size, std::size_t count, bool withStatus)
+    : m_file(path, sizeof(Header) + count * size * SquareMatrix<int>::paddedStride(size) * sizeof(int) +
+                       (withStatus ? count : 0)),
+      m_size(size), m_stride(SquareMatrix<int>::paddedStride(size)), m_count(count)
+{
+    const Header header = makeHeader(size, count, withStatus);
+    std::memcpy(m_file.data(), &header, sizeof(header));
+    layout(withStatus);
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixFile::layout(bool withStatus)
+{
+    std::byte* data = m_file.data() + sizeof(Header);
+    m_data = reinterpret_cast<int*>(data);
+    if (withStatus)
+        m_status = reinterpret_cast<std::uint8_t*>(data + m_count * m_size * m_stride * sizeof(int));
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixView<const int> MatrixFile::matrix(std::size_t i) const
+{
+    assert(i < m_count);
+    return MatrixView<const int>(m_data + i * m_size * m_stride, m_size, m_size, m_stride);
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixView<int> MatrixFile::matrix(std::size_t i)
+{
+    assert(i < m_count);
+    return MatrixView<int>(m_data + i * m_size * m_stride, m_size, m_size, m_stride);
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixFile::outOfRange(std::size_t i) const
+{
+    return m_status && m_status[i] != 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixFile::setOutOfRange(std::size_t i)
+{
+    assert(m_status);
+    m_status[i] = 1;
+}
+
+//-----------------------------------------------------------------------------
+
+// The matrices are streamed: the header is written again with the count
+// once they are all read
+std::size_t writeMatrixFile(std::istream& input, const std::string& path, std::size_t size)
+{
+    std::ofstream output(path, std::ios::binary);
+    if (!output.is_open())
+        throw FileException("Failed to create the file " + path + ".");
+
+    Header header = makeHeader(size, 0, false);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // A SquareMatrix buffer has the layout of a matrix in the file
+    const auto blank = SquareMatrix<int>(size, SquareMatrix<int>::Uninitialized{});
+    const auto bytes = static_cast<std::streamsize>(size * blank.stride() * sizeof(int));
+    std::vector<SquareMatrix<int>> chunk(std::max<std::size_t>(1, BATCH_CHUNK_ELEMENTS / (size * size)), blank);
+
+    std::size_t count = 0;
+    std::exception_ptr badMatrix;
+    while (!badMatrix)
+    {
+        const std::size_t read = readBatchSets(input, chunk, 1, count, badMatrix);
+        if (read == 0)
+            break;
+        for (std::size_t i = 0; i < read; ++i)
+            output.write(reinterpret_cast<const char*>(chunk[i].data()), bytes);
+        count += read;
+    }
+    if (badMatrix)
+        std::rethrow_exception(badMatrix);
+
+    header.count = count;
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!output)
+        throw std::runtime_error("Failed to write the file " + path + ".");
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+// The matrices are rendered straight from the mapping
+void writeMatrixText(const MatrixFile& file, std::ostream& output)
+{
+    MatrixFormatter formatter;
+    for (std::size_t i = 0; i < file.count(); ++i)
+    {
+        if (file.outOfRange(i))
+            formatter.append(RANGE_ERROR_MESSAGE).append("\n\n");
+        // A large matrix is written a band of rows at a time
+        else if (file.size() * file.size() > FORMAT_BUFFER_BYTES)
+        {
+            formatter.write(output, file.matrix(i));
+            formatter.append("\n");
+        }
+        else
+            formatter.append(file.matrix(i)).append("\n");
+
+        if (formatter.text().size() >= FORMAT_BUFFER_BYTES)
+            formatter.flush(output);
+    }
+    formatter.flush(output);
+
+    if (!output)
+        throw std::runtime_error("Failed to write the results.");
+}
@@ -0,0 +1,96 @@
+#include "MatrixFormatter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <ostream>
+
+namespace
+{
+    // Characters of the longest value of T and a space: the sign, the
+    // digits and, for floating point, the point and the exponent
+    template <typename T>
+    constexpr std::size_t MAX_VALUE_CHARS = std::numeric_limits<T>::is_integer
+        ? std::numeric_limits<T>::digits10 + 3
+        : std::numeric_limits<T>::max_digits10 + 8;
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFormatter& MatrixFormatter::local()
+{
+    thread_local MatrixFormatter formatter;
+    return formatter;
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFormatter& MatrixFormatter::append(MatrixView<const int> matrix) { return appendValues(matrix); }
+MatrixFormatter& MatrixFormatter::append(MatrixView<const std::int16_t> matrix) { return appendValues(matrix); }
+MatrixFormatter& MatrixFormatter::append(MatrixView<const std::int64_t> matrix) { return appendValues(matrix); }
+MatrixFormatter& MatrixFormatter::append(MatrixView<const float> matrix) { return appendValues(matrix); }
+MatrixFormatter& MatrixFormatter::append(MatrixView<const double> matrix) { return appendValues(matrix); }
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+MatrixFormatter& MatrixFormatter::appendValues(MatrixView<const T> matrix)
+{
+    const std::size_t before = m_text.size();
+    const std::size_t most = before + matrix.rows() * (matrix.cols() * MAX_VALUE_CHARS<T> + 1);
+
+    m_text.resize_and_overwrite(most, [&](char* text, std::size_t)
+    {
+        char* out = text + before;
+        for (std::size_t i = 0; i < matrix.rows(); ++i)
+        {
+            for (const T value : matrix.row(i))
+            {
+                out = std::to_chars(out, out + MAX_VALUE_CHARS<T>, value).ptr;
+                *out++ = ' ';
+            }
+            *out++ = '\n';
+        }
+        return static_cast<std::size_t>(out - text);
+    });
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixFormatter& MatrixFormatter::append(std::string_view text)
+{
+    m_text += text;
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixFormatter::flush(std::ostream& ostr)
+{
+    ostr.write(m_text.data(), static_cast<std::streamsize>(m_text.size()));
+    m_text.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixFormatter::write(std::ostream& ostr, MatrixView<const int> matrix) { writeBands(ostr, matrix); }
+void MatrixFormatter::write(std::ostream& ostr, MatrixView<const std::int16_t> matrix) { writeBands(ostr, matrix); }
+void MatrixFormatter::write(std::ostream& ostr, MatrixView<const std::int64_t> matrix) { writeBands(ostr, matrix); }
+void MatrixFormatter::write(std::ostream& ostr, MatrixView<const float> matrix) { writeBands(ostr, matrix); }
+void MatrixFormatter::write(std::ostream& ostr, MatrixView<const double> matrix) { writeBands(ostr, matrix); }
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+void MatrixFormatter::writeBands(std::ostream& ostr, MatrixView<const T> matrix)
+{
+    const std::size_t rowChars = matrix.cols() * MAX_VALUE_CHARS<T> + 1;
+    const std::size_t band = std::max<std::size_t>(1, FORMAT_BUFFER_BYTES / rowChars);
+
+    for (std::size_t row = 0; row < matrix.rows(); row += band)
+    {
+        append(matrix.subview(row, 0, std::min(band, matrix.rows() - row), matrix.cols()));
+        flush(ostr);
+    }
+}
@@ -0,0 +1,429 @@
+#include "MatrixKernels.h"
+#include "GemmKernel.h"
+#include "ElementKernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATRIX_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MATRIX_TARGET_SSE2
+#define MATRIX_TARGET_AVX2
+#define MATRIX_FLATTEN
+#else
+#define MATRIX_TARGET_SSE2 __attribute__((target("sse2")))
+#define MATRIX_TARGET_AVX2 __attribute__((target("avx2")))
+#define MATRIX_FLATTEN __attribute__((flatten))
+#endif
+#endif
+
+namespace
+{
+    // Number of elements computed before each range reduction
+    const std::size_t TILE = 1024;
+
+    using BinaryKernel = bool (*)(int*, const int*, const int*, std::size_t, int, int);
+    using ScaleKernel = bool (*)(int*, const int*, int, std::size_t, int, int);
+    using GemmKernel = bool (*)(MatrixView<const int>, MatrixView<const int>,
+                                MatrixView<int>, std::int64_t, std::int64_t, RangePolicy);
+
+    // add and sub come in two versions: the one that also detects an int
+    // overflow is only taken when the operands are in a range wide enough
+    // for one to happen. scale checks its source against bounds derived from
+    // the scalar instead of its result, so it cannot miss an overflow.
+    // gemm has a version with 64-bit panels for such ranges too.
+    struct KernelTable
+    {
+        BinaryKernel add;
+        BinaryKernel sub;
+        BinaryKernel addDetectingOverflow;
+        BinaryKernel subDetectingOverflow;
+        ScaleKernel scale;
+        GemmKernel gemm;
+        GemmKernel gemmWide;
+        const char* name;
+    };
+
+    // Wrapping arithmetic, so an overflow is not undefined behaviour
+    unsigned wrapAddSub(bool subtract, unsigned a, unsigned b) { return subtract ? a - b : a + b; }
+    int wrapMul(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b)); }
+
+    // The sign bit is set when r = a +/- b overflowed: a sum has a sign other
+    // than both operands, a difference has a and b, and a and r, of
+    // different signs
+    unsigned overflowBits(bool subtract, unsigned a, unsigned b, unsigned r)
+    {
+        return subtract ? (a ^ b) & (a ^ r) : (a ^ r) & (b ^ r);
+    }
+
+    //-------------------------------------------------------------------------
+    // Plain C++ - also used for the tail of every vector tile
+
+    template <bool Subtract, bool DetectOverflow>
+    bool scalarBinary(int* dst, const int* lhs, const int* rhs, std::size_t count,
+                      int low, int high)
+    {
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            int minValue = high, maxValue = low;
+            unsigned overflow = 0;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                const auto a = static_cast<unsigned>(lhs[i]), b = static_cast<unsigned>(rhs[i]);
+                const unsigned r = wrapAddSub(Subtract, a, b);
+                if constexpr (DetectOverflow)
+                    overflow |= overflowBits(Subtract, a, b, r);
+                const int value = static_cast<int>(r);
+                dst[i] = value;
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
+            }
+            if (minValue < low || maxValue > high || overflow >> 31 != 0) return false;
+        }
+        return true;
+    }
+
+    // [low, high] bounds the source here (see scaledSourceBounds)
+    bool scalarScale(int* dst, const int* src, int scalar, std::size_t count,
+                     int low, int high)
+    {
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            int minValue = high, maxValue = low;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                dst[i] = wrapMul(src[i], scalar);
+                minValue = std::min(minValue, src[i]);
+                maxValue = std::max(maxValue, src[i]);
+            }
+            if (minValue < low || maxValue > high) return false;
+        }
+        return true;
+    }
+
+    template <typename Traits>
+    bool scalarGemm(MatrixView<const int> a, MatrixView<const int> b, MatrixView<int> c,
+                    std::int64_t low, std::int64_t high, RangePolicy policy)
+    {
+        return gemmBlocked<int, Traits>(a, b, c, low, high, policy);
+    }
+
+#ifdef MATRIX_KERNELS_X86
+    //-------------------------------------------------------------------------
+    // SSE2 - no 32-bit min/max or multiply, so out-of-range lanes are
+    // collected with compares and the multiply is built from _mm_mul_epu32
+
+    MATRIX_TARGET_SSE2
+    __m128i sse2Mul(__m128i a, __m128i b)
+    {
+        const __m128i even = _mm_mul_epu32(a, b);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    MATRIX_TARGET_SSE2
+    bool sse2OutOfRange(__m128i bad)
+    {
+        return _mm_movemask_epi8(bad) != 0;
+    }
+
+    // Sets the sign bit of the lanes where r = a +/- b overflowed
+    template <bool Subtract>
+    MATRIX_TARGET_SSE2
+    __m128i sse2Overflow(__m128i a, __m128i b, __m128i r)
+    {
+        return Subtract ? _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r))
+                        : _mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r));
+    }
+
+    template <bool Subtract, bool DetectOverflow>
+    MATRIX_TARGET_SSE2
+    bool sse2Binary(int* dst, const int* lhs, const int* rhs, std::size_t count,
+                    int low, int high)
+    {
+        const __m128i lowV = _mm_set1_epi32(low);
+        const __m128i highV = _mm_set1_epi32(high);
+
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            __m128i bad = _mm_setzero_si128();
+            std::size_t i = begin;
+            for (; i + 4 <= end; i += 4)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i));
+                const __m128i r = Subtract ? _mm_sub_epi32(a, b) : _mm_add_epi32(a, b);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+                bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmplt_epi32(r, lowV),
+                                                     _mm_cmpgt_epi32(r, highV)));
+                if constexpr (DetectOverflow)
+                    bad = _mm_or_si128(bad, _mm_srai_epi32(sse2Overflow<Subtract>(a, b, r), 31));
+            }
+            if (sse2OutOfRange(bad)) return false;
+            if (!scalarBinary<Subtract, DetectOverflow>(dst + i, lhs + i, rhs + i, end - i, low, high))
+                return false;
+        }
+        return true;
+    }
+
+    // [low, high] bounds the source here (see scaledSourceBounds)
+    MATRIX_TARGET_SSE2
+    bool sse2Scale(int* dst, const int* src, int scalar, std::size_t count,
+                   int low, int high)
+    {
+        const __m128i lowV = _mm_set1_epi32(low);
+        const __m128i highV = _mm_set1_epi32(high);
+        const __m128i scalarV = _mm_set1_epi32(scalar);
+
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            __m128i bad = _mm_setzero_si128();
+            std::size_t i = begin;
+            for (; i + 4 <= end; i += 4)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sse2Mul(a, scalarV));
+                bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmplt_epi32(a, lowV),
+                                                     _mm_cmpgt_epi32(a, highV)));
+            }
+            if (sse2OutOfRange(bad)) return false;
+            if (!scalarScale(dst + i, src + i, scalar, end - i, low, high)) return false;
+        }
+        return true;
+    }
+
+    //-------------------------------------------------------------------------
+    // AVX2 - running vector min/max, reduced once per tile
+
+    MATRIX_TARGET_AVX2
+    bool avx2OutOfRange(__m256i minV, __m256i maxV, int low, int high)
+    {
+        const __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(low), minV),
+                                            _mm256_cmpgt_epi32(maxV, _mm256_set1_epi32(high)));
+        return _mm256_movemask_epi8(bad) != 0;
+    }
+
+    // Sets the sign bit of the lanes where r = a +/- b overflowed
+    template <bool Subtract>
+    MATRIX_TARGET_AVX2
+    __m256i avx2Overflow(__m256i a, __m256i b, __m256i r)
+    {
+        return Subtract ? _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r))
+                        : _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r));
+    }
+
+    template <bool Subtract, bool DetectOverflow>
+    MATRIX_TARGET_AVX2
+    bool avx2Binary(int* dst, const int* lhs, const int* rhs, std::size_t count,
+                    int low, int high)
+    {
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            __m256i minV = _mm256_set1_epi32(high);
+            __m256i maxV = _mm256_set1_epi32(low);
+            __m256i overflow = _mm256_setzero_si256();
+            std::size_t i = begin;
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i));
+                const __m256i r = Subtract ? _mm256_sub_epi32(a, b) : _mm256_add_epi32(a, b);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+                minV = _mm256_min_epi32(minV, r);
+                maxV = _mm256_max_epi32(maxV, r);
+                if constexpr (DetectOverflow)
+                    overflow = _mm256_or_si256(overflow, avx2Overflow<Subtract>(a, b, r));
+            }
+            if (avx2OutOfRange(minV, maxV, low, high) ||
+                _mm256_movemask_ps(_mm256_castsi256_ps(overflow)) != 0)
+            {
+                return false;
+            }
+            if (!scalarBinary<Subtract, DetectOverflow>(dst + i, lhs + i, rhs + i, end - i, low, high))
+                return false;
+        }
+        return true;
+    }
+
+    // [low, high] bounds the source here (see scaledSourceBounds)
+    MATRIX_TARGET_AVX2
+    bool avx2Scale(int* dst, const int* src, int scalar, std::size_t count,
+                   int low, int high)
+    {
+        const __m256i scalarV = _mm256_set1_epi32(scalar);
+
+        for (std::size_t begin = 0; begin < count; begin += TILE)
+        {
+            const std::size_t end = std::min(count, begin + TILE);
+            __m256i minV = _mm256_set1_epi32(high);
+            __m256i maxV = _mm256_set1_epi32(low);
+            std::size_t i = begin;
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_mullo_epi32(a, scalarV));
+                minV = _mm256_min_epi32(minV, a);
+                maxV = _mm256_max_epi32(maxV, a);
+            }
+            if (avx2OutOfRange(minV, maxV, low, high)) return false;
+            if (!scalarScale(dst + i, src + i, scalar, end - i, low, high)) return false;
+        }
+        return true;
+    }
+
+    // The whole GEMM is inlined here, so the micro-kernel is compiled for AVX2
+    template <typename Traits>
+    MATRIX_TARGET_AVX2 MATRIX_FLATTEN
+    bool avx2Gemm(MatrixView<const int> a, MatrixView<const int> b, MatrixView<int> c,
+                  std::int64_t low, std::int64_t high, RangePolicy policy)
+    {
+        return gemmBlocked<int, Traits>(a, b, c, low, high, policy);
+    }
+
+    //-------------------------------------------------------------------------
+
+    bool cpuHasAvx2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool cpuHasSse2()
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        return true;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+#endif
+
+    //-------------------------------------------------------------------------
+
+    KernelTable selectKernels()
+    {
+        const KernelTable scalarTable{ scalarBinary<false, false>, scalarBinary<true, false>,
+                                       scalarBinary<false, true>, scalarBinary<true, true>, scalarScale,
+                                       scalarGemm<GemmTraits<int>>, scalarGemm<WideIntGemmTraits>, "scalar" };
+
+        // MATRIX_ISA=scalar|sse2 caps the selection (for comparing the paths)
+        const char* requested = std::getenv("MATRIX_ISA");
+        const std::string_view cap = requested ? requested : "";
+        if (cap == "scalar") return scalarTable;
+
+#ifdef MATRIX_KERNELS_X86
+        if (cap != "sse2" && cpuHasAvx2())
+            return { avx2Binary<false, false>, avx2Binary<true, false>,
+                     avx2Binary<false, true>, avx2Binary<true, true>, avx2Scale,
+                     avx2Gemm<GemmTraits<int>>, avx2Gemm<WideIntGemmTraits>, "avx2" };
+        if (cpuHasSse2())
+            return { sse2Binary<false, false>, sse2Binary<true, false>,
+                     sse2Binary<false, true>, sse2Binary<true, true>, sse2Scale,
+                     scalarGemm<GemmTraits<int>>, scalarGemm<WideIntGemmTraits>, "sse2" };
+#endif
+        return scalarTable;
+    }
+
+    const KernelTable& kernels()
+    {
+        static const KernelTable table = selectKernels();
+        return table;
+    }
+
+    // Whether a sum or difference of two values in [low, high] can overflow
+    // an int and has to be detected
+    bool detectsOverflow(int low, int high, RangePolicy policy)
+    {
+        const std::int64_t lowest = std::numeric_limits<int>::lowest(), max = std::numeric_limits<int>::max();
+        return policy == RangePolicy::Checked &&
+               (2 * std::int64_t{ low } < lowest || 2 * std::int64_t{ high } > max ||
+                std::int64_t{ high } - low > max);
+    }
+
+    // Whether a GEMM_KC slice of products of values in [low, high] can pass
+    // the 32 bits of the GemmTraits<int> panels (unchecked sums wrap anyway)
+    bool needsWideGemm(std::int64_t low, std::int64_t high, RangePolicy policy)
+    {
+        const std::int64_t magnitude = std::max(-low, high);
+        return policy == RangePolicy::Checked &&
+               magnitude * magnitude >= std::int64_t{ std::numeric_limits<int>::max() } / static_cast<std::int64_t>(GEMM_KC);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixKernels::add(int* dst, const int* lhs, const int* rhs, std::size_t count,
+                        int low, int high, RangePolicy policy)
+{
+    const KernelTable& table = kernels();
+    const BinaryKernel kernel = detectsOverflow(low, high, policy) ? table.addDetectingOverflow : table.add;
+    return kernel(dst, lhs, rhs, count, low, high);
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixKernels::sub(int* dst, const int* lhs, const int* rhs, std::size_t count,
+                        int low, int high, RangePolicy policy)
+{
+    const KernelTable& table = kernels();
+    const BinaryKernel kernel = detectsOverflow(low, high, policy) ? table.subDetectingOverflow : table.sub;
+    return kernel(dst, lhs, rhs, count, low, high);
+}
+
+//-----------------------------------------------------------------------------
+
+// Unchecked values wrap, so any source will do
+bool MatrixKernels::scale(int* dst, const int* src, int scalar, std::size_t count,
+                          int low, int high, RangePolicy policy)
+{
+    const auto [sourceLow, sourceHigh] = policy == RangePolicy::Checked
+        ? ElementKernels::scaledSourceBounds(scalar, low, high)
+        : std::pair(std::numeric_limits<int>::lowest(), std::numeric_limits<int>::max());
+    return kernels().scale(dst, src, scalar, count, sourceLow, sourceHigh);
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixKernels::gemm(MatrixView<const int> a, MatrixView<const int> b, MatrixView<int> c,
+                         std::int64_t low, std::int64_t high, RangePolicy policy)
+{
+    const KernelTable& table = kernels();
+    return (needsWideGemm(low, high, policy) ? table.gemmWide : table.gemm)(a, b, c, low, high, policy);
+}
+
+//-----------------------------------------------------------------------------
+
+const char* MatrixKernels::isaName()
+{
+    return kernels().name;
+}
@@ -0,0 +1,97 @@
+#include "MatrixPool.h"
+
+#include <algorithm>
+#include <bit>
+
+//-----------------------------------------------------------------------------
+
+MatrixPool::MatrixPool(std::pmr::memory_resource* upstream) : m_upstream(upstream)
+{
+}
+
+//-----------------------------------------------------------------------------
+
+MatrixPool::~MatrixPool()
+{
+    release();
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixPool::release()
+{
+    for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket)
+    {
+        while (FreeBlock* block = m_buckets[bucket])
+        {
+            m_buckets[bucket] = block->next;
+            m_upstream->deallocate(block, blockSize(bucket), MATRIX_ALIGNMENT);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// Bucket 0 holds MIN_BLOCK bytes; above it, the sizes between two powers of
+// two are split into four classes
+std::size_t MatrixPool::bucketOf(std::size_t bytes, std::size_t alignment)
+{
+    if (alignment > MATRIX_ALIGNMENT)
+        return BUCKET_COUNT;
+    if (bytes <= MIN_BLOCK)
+        return 0;
+
+    const std::size_t last = bytes - 1;
+    const unsigned width = static_cast<unsigned>(std::bit_width(last));
+    if (width > MAX_POOLED_WIDTH)
+        return BUCKET_COUNT;
+    return (width - 7) * 4 + (last >> (width - 3)) - 3;
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t MatrixPool::blockSize(std::size_t bucket)
+{
+    if (bucket == 0)
+        return MIN_BLOCK;
+
+    const std::size_t width = (bucket - 1) / 4 + 7;
+    return (5 + (bucket - 1) % 4) << (width - 3);
+}
+
+//-----------------------------------------------------------------------------
+
+void* MatrixPool::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    const std::size_t bucket = bucketOf(bytes, alignment);
+    if (bucket == BUCKET_COUNT)
+        return m_upstream->allocate(bytes, alignment);
+
+    if (FreeBlock* block = m_buckets[bucket])
+    {
+        m_buckets[bucket] = block->next;
+        return block;
+    }
+    return m_upstream->allocate(blockSize(bucket), MATRIX_ALIGNMENT);
+}
+
+//-----------------------------------------------------------------------------
+
+void MatrixPool::do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment)
+{
+    const std::size_t bucket = bucketOf(bytes, alignment);
+    if (bucket == BUCKET_COUNT)
+    {
+        m_upstream->deallocate(ptr, bytes, alignment);
+        return;
+    }
+
+    m_buckets[bucket] = ::new (ptr) FreeBlock{ m_buckets[bucket] };
+}
+
+//-----------------------------------------------------------------------------
+
+bool MatrixPool::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
@@ -0,0 +1,28 @@
+#include "MemoryStats.h"
+
+//-----------------------------------------------------------------------------
+
+MemoryStats::PeakScope::PeakScope(std::size_t& peakBytes)
+    : m_peakBytes(peakBytes), m_base(t_matrixBytes), m_outerPeak(t_peakMatrixBytes)
+{
+    t_peakMatrixBytes = t_matrixBytes;
+}
+
+//-----------------------------------------------------------------------------
+
+// An enclosing scope still sees the peak of this one
+MemoryStats::PeakScope::~PeakScope()
+{
+    m_peakBytes = static_cast<std::size_t>(std::max<std::int64_t>(t_peakMatrixBytes - m_base, 0));
+    t_peakMatrixBytes = std::max(t_peakMatrixBytes, m_outerPeak);
+}
+
+//-----------------------------------------------------------------------------
+
+MemoryStats::Totals MemoryStats::totals(MemoryKind kind)
+{
+    const Counters& counters = s_counters[static_cast<std::size_t>(kind)];
+    return { counters.liveBytes.load(std::memory_order_relaxed),
+             counters.allocations.load(std::memory_order_relaxed),
+             counters.deallocations.load(std::memory_order_relaxed) };
+}
@@ -0,0 +1,25 @@
+#include "Mul.h"
+#include <iostream>
+
+//-----------------------------------------------------------------------------
+
+Operation::T Mul::compute(Inputs input) const
+{
+    const auto [a, b] = computeOperands(input);
+
+    return a * b;
+}
+
+//-----------------------------------------------------------------------------
+
+void Mul::printSymbol(std::ostream& ostr) const
+{
+    ostr << '*';
+}
+
+//-----------------------------------------------------------------------------
+
+void Mul::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
@@ -1,13 +1,18 @@
 #include "Operation.h"
+#include "MatrixFormatter.h"
 #include <iostream>
 
 //-----------------------------------------------------------------------------
 
-void Operation::print(std::ostream& ostr, const std::vector<T>& input) const
+// The inputs are rendered together and written at once
+void Operation::print(std::ostream& ostr, std::span<const T> input) const
 {
 	print(ostr);
-	for (int i = 0; i < inputCount(); ++i)
+	auto& formatter = MatrixFormatter::local();
+	const auto count = static_cast<std::size_t>(inputCount());
+	for (std::size_t i = 0; i < count; ++i)
 	{
-		ostr << "(\n" << input[i] << ")";
+		formatter.append("(\n").append(input[i].view()).append(")");
 	}
+	formatter.flush(ostr);
 }
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "OperationRegistry.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "Mul.h"
+#include "Comp.h"
+#include "OperationVisitor.h"
+
+#include <unordered_set>
+
+namespace
+{
+    // Walks the operation DAG once, counting every node the first time it
+    // is reached and the nodes reached again as shared
+    class NodeCounter : public OperationVisitor
+    {
+    public:
+        explicit NodeCounter(OperationRegistry::Usage& usage) : m_usage(usage) {}
+
+        void count(const Operation& operation)
+        {
+            if (!m_seen.insert(&operation).second)
+            {
+                if (m_shared.insert(&operation).second)
+                    ++m_usage.sharedNodes;
+                return;
+            }
+            ++m_usage.uniqueNodes;
+            operation.accept(*this);
+        }
+
+        void visit(const Identity&) override  { m_usage.bytes += sizeof(Identity); }
+        void visit(const Transpose&) override { m_usage.bytes += sizeof(Transpose); }
+        void visit(const Scalar&) override    { m_usage.bytes += sizeof(Scalar); }
+        void visit(const Add& operation) override  { binary(operation, sizeof(Add)); }
+        void visit(const Sub& operation) override  { binary(operation, sizeof(Sub)); }
+        void visit(const Mul& operation) override  { binary(operation, sizeof(Mul)); }
+        void visit(const Comp& operation) override { binary(operation, sizeof(Comp)); }
+
+    private:
+        void binary(const BinaryOperation& operation, std::size_t size)
+        {
+            m_usage.bytes += size;
+            count(*operation.first());
+            count(*operation.second());
+        }
+
+        OperationRegistry::Usage& m_usage;
+        std::unordered_set<const Operation*> m_seen;
+        std::unordered_set<const Operation*> m_shared;
+    };
+}
+
+//-----------------------------------------------------------------------------
+
+OperationRegistry::OperationRegistry(int maxOperations)
+{
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->operations = { makeOperation<Identity>(), makeOperation<Transpose>() };
+    snapshot->evaluated = snapshot->operations;
+    snapshot->maxOperations = maxOperations;
+    m_current.store(std::move(snapshot));
+}
+
+//-----------------------------------------------------------------------------
+
+std::shared_ptr<const OperationRegistry::Snapshot> OperationRegistry::current() const
+{
+    return m_current.load();
+}
+
+//-----------------------------------------------------------------------------
+
+// An operation that is evaluated as it is (no simplification) is one node,
+// listed twice
+OperationRegistry::Usage OperationRegistry::usage(const Snapshot& snapshot)
+{
+    Usage usage;
+    usage.bytes = sizeof(Snapshot) +
+                  (snapshot.operations.capacity() + snapshot.evaluated.capacity()) *
+                  sizeof(OperationList::value_type);
+
+    NodeCounter counter(usage);
+    for (std::size_t i = 0; i < snapshot.operations.size(); ++i)
+    {
+        counter.count(*snapshot.operations[i]);
+        if (snapshot.evaluated[i] != snapshot.operations[i])
+            counter.count(*snapshot.evaluated[i]);
+    }
+    return usage;
+}
@@ -0,0 +1,102 @@
+#include "Profiler.h"
+#include "BinaryOperation.h"
+#include "MemoryStats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+//-----------------------------------------------------------------------------
+
+Profiler::Scope::Scope(Profiler& profiler, const Operation& node) : m_profiler(profiler)
+{
+    m_profiler.m_frames.push_back({ &node, Clock::now(), {}, MemoryStats::allocatedByThread() });
+}
+
+//-----------------------------------------------------------------------------
+
+// The node's time and bytes, less those of its children, are its own
+Profiler::Scope::~Scope()
+{
+    const Frame frame = m_profiler.m_frames.back();
+    m_profiler.m_frames.pop_back();
+
+    const Clock::duration inclusive = Clock::now() - frame.start;
+    const std::size_t bytes = MemoryStats::allocatedByThread() - frame.allocatedAtStart;
+
+    NodeStats& stats = m_profiler.m_nodes[frame.node];
+    ++stats.calls;
+    stats.inclusive += inclusive;
+    stats.exclusive += inclusive - frame.children;
+    stats.bytes += bytes - frame.childBytes;
+
+    if (!m_profiler.m_frames.empty())
+    {
+        m_profiler.m_frames.back().children += inclusive;
+        m_profiler.m_frames.back().childBytes += bytes;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+Profiler::Profiler() : m_previous(s_active)
+{
+    s_active = this;
+}
+
+//-----------------------------------------------------------------------------
+
+Profiler::~Profiler()
+{
+    s_active = m_previous;
+}
+
+//-----------------------------------------------------------------------------
+
+void Profiler::print(std::ostream& ostr, const Operation& root) const
+{
+    ostr << "\n     calls  inclusive us  exclusive us         bytes  operation\n";
+    std::vector<const Operation*> printed;
+    printNode(ostr, root, 0, printed);
+}
+
+//-----------------------------------------------------------------------------
+
+// A node the DAG shares is printed with its counters once, where it is met
+// first; the other places it appears in are marked as shared
+void Profiler::printNode(std::ostream& ostr, const Operation& node, int depth,
+                         std::vector<const Operation*>& printed) const
+{
+    const auto micros = [](Clock::duration time)
+    {
+        return std::chrono::duration<double, std::micro>(time).count();
+    };
+
+    const bool shared = std::ranges::find(printed, &node) != printed.end();
+    const auto stats = m_nodes.find(&node);
+    if (shared)
+        ostr << std::setw(54) << "shared";
+    else if (stats == m_nodes.end())
+        ostr << std::setw(54) << "not computed";
+    else
+    {
+        ostr << std::setw(10) << stats->second.calls << std::fixed << std::setprecision(1)
+             << std::setw(14) << micros(stats->second.inclusive)
+             << std::setw(14) << micros(stats->second.exclusive)
+             << std::setw(14) << stats->second.bytes << std::defaultfloat;
+    }
+
+    ostr << "  " << std::string(static_cast<std::size_t>(depth) * 2, ' ');
+    node.print(ostr, depth == 0);
+    ostr << '\n';
+    if (shared)
+        return;
+
+    printed.push_back(&node);
+    if (const auto binary = dynamic_cast<const BinaryOperation*>(&node))
+    {
+        printNode(ostr, *binary->first(), depth + 1, printed);
+        printNode(ostr, *binary->second(), depth + 1, printed);
+    }
+}
@@ -1,55 +1,195 @@
 #include "Read.h"
 #include "FunctionCalculator.h"
 
-//-----------------------------------------------------------------------------
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <span>
 
-Read::Read(FunctionCalculator* funcPtr, std::string pathName) 
-	: m_funcPtr(funcPtr), m_inputFile(pathName)
+namespace
 {
-	if (!m_inputFile.is_open())
+	bool isBlank(std::string_view text)
 	{
-		throw FileException("Failed to open the file.");
+		return text.find_first_not_of(" \t\r\v\f") == std::string_view::npos;
 	}
+
+	// Gives 'stream' another stream buffer until the end of the scope
+	class BufferSwap
+	{
+	public:
+		BufferSwap(std::istream& stream, std::streambuf* buffer)
+			: m_stream(stream), m_state(stream.rdstate()), m_buffer(stream.rdbuf(buffer)) {}
+
+		~BufferSwap()
+		{
+			m_stream.rdbuf(m_buffer);
+			m_stream.clear(m_state);
+		}
+
+	private:
+		std::istream& m_stream;
+		std::ios::iostate m_state;
+		std::streambuf* m_buffer;
+	};
 }
 
 //-----------------------------------------------------------------------------
 
-Read::~Read()
+Read::Read(FunctionCalculator* funcPtr, std::string pathName, std::istream& input,
+           std::ostream& output, ScriptPolicy policy)
+	: m_funcPtr(funcPtr), m_pathName(pathName), m_input(input), m_output(output),
+	  m_policy(policy), m_file(pathName)
 {
-	if (m_inputFile.is_open())
+	m_text = std::string_view(reinterpret_cast<const char*>(m_file.data()), m_file.size());
+
+	for (std::size_t start = 0; start < m_text.size();)
 	{
-		m_inputFile.close();
+		const std::size_t end = std::min(m_text.find('\n', start), m_text.size());
+		std::string_view line = m_text.substr(start, end - start);
+		if (line.ends_with('\r'))
+			line.remove_suffix(1);
+
+		m_lines.push_back(line);
+		start = end + 1;
 	}
 }
 
 //-----------------------------------------------------------------------------
 
-void Read::readFile()
+std::size_t Read::lineAt(std::size_t position) const
+{
+	const char* at = m_text.data() + position;
+	const auto next = std::ranges::upper_bound(m_lines, at, std::less<>(),
+	                                           [](std::string_view line) { return line.data(); });
+	return static_cast<std::size_t>(next - m_lines.begin()) - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Read::readFile()
 {
-	std::string lineCommand;
-	while (std::getline(m_inputFile, lineCommand))
+	const auto start = std::chrono::steady_clock::now();
+	const bool unattended = m_policy != ScriptPolicy::Ask;
+
+	// Unattended, the calculator reads whatever a command asks for (the
+	// matrices of eval) from the script, right after the command
+	std::ispanstream script(std::span<const char>(m_text.data(), m_text.size()));
+	std::optional<BufferSwap> swap;
+	if (unattended)
+		swap.emplace(m_input, script.rdbuf());
+
+	std::size_t commands = 0;
+	bool completed = true;
+	std::size_t position = 0;
+	while (position < m_text.size())
 	{
-		try 
+		// A command may have read part of the line it stopped in
+		const std::size_t line = lineAt(position);
+		const std::size_t offset = position - static_cast<std::size_t>(m_lines[line].data() - m_text.data());
+		const std::string_view command = m_lines[line].substr(std::min(offset, m_lines[line].size()));
+		const std::size_t next = line + 1 < m_lines.size()
+			? static_cast<std::size_t>(m_lines[line + 1].data() - m_text.data()) : m_text.size();
+		position = next;
+		if (isBlank(command))
+			continue;
+
+		++commands;
+		try
 		{
-			m_funcPtr->setStreams(lineCommand);
+			if (unattended)
+			{
+				m_input.clear();
+				script.rdbuf()->pubseekpos(static_cast<std::streamoff>(next), std::ios::in);
+			}
+			m_funcPtr->setStreams(command);
 			m_funcPtr->executeCommand();
-		} 
+		}
 		catch (const ReadException& e)
 		{
-			printException(e.what(), lineCommand);
-			std::cin.clear();
-
-			std::string input;
-			while(std::cin >> input)
+			if (!handleFailure({ line + 1, std::string(command), e.what() }))
 			{
-				std::cout << "\n================================================" <<
-							 "==============================\n";
-				if (input == "Yes") break;
-				else if (input == "No") return;
-				std::cout << "\nInvalid input! Please enter 'Yes' or 'No': ";
+				completed = false;
+				break;
 			}
 		}
+
+		if (unattended)
+		{
+			const auto read = script.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in);
+			position = std::max(position, static_cast<std::size_t>(read));
+		}
+	}
+
+	if (m_policy == ScriptPolicy::Collect && !m_failures.empty())
+	{
+		m_output << "\nThe commands of " << m_pathName << " that failed:\n";
+		for (const auto& failure : m_failures)
+			printFailure(failure);
+	}
+	printReport(commands, std::chrono::steady_clock::now() - start, completed);
+	return completed;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Read::handleFailure(const Failure& failure)
+{
+	switch (m_policy)
+	{
+		case ScriptPolicy::Abort:
+			m_failures.push_back(failure);
+			printFailure(failure);
+			return false;
+
+		case ScriptPolicy::Skip:
+			m_failures.push_back(failure);
+			printFailure(failure);
+			return true;
+
+		case ScriptPolicy::Collect:
+			m_failures.push_back(failure);
+			return true;
+
+		case ScriptPolicy::Ask:
+			break;
+	}
+
+	m_failures.push_back(failure);
+	printException(failure.message, failure.command);
+	std::cin.clear();
+
+	std::string input;
+	while(std::cin >> input)
+	{
+		std::cout << "\n================================================" <<
+					 "==============================\n";
+		if (input == "Yes") return true;
+		else if (input == "No") return false;
+		std::cout << "\nInvalid input! Please enter 'Yes' or 'No': ";
 	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Read::printFailure(const Failure& failure) const
+{
+	m_output << "\nError in " << m_pathName << ", line " << failure.line << " ("
+	         << failure.command << "): " << failure.message;
+}
+
+//-----------------------------------------------------------------------------
+
+void Read::printReport(std::size_t commands, std::chrono::steady_clock::duration time,
+                       bool completed) const
+{
+	m_output << "\nScript " << m_pathName << ": " << commands << " commands ("
+	         << m_failures.size() << " failed) in "
+	         << std::chrono::duration<double>(time).count() << " s";
+	if (!completed)
+		m_output << ", stopped at line " << m_failures.back().line;
+	m_output << ".\n";
 }
 
 //-----------------------------------------------------------------------------
@@ -61,4 +201,4 @@ void Read::printException(std::string message, std::string lineCommand)
 	std::cerr << message << '\n';
 	std::cout << "Do you want to continue?" <<
 				 "\nEnter 'Yes' to continue\nEnter 'No' to stop: ";
-}
\ No newline at end of file
+}
@@ -8,7 +8,7 @@ Scalar::Scalar(int scalar)
 
 //-----------------------------------------------------------------------------
 
-Operation::T Scalar::compute(const std::vector<T>& input) const
+Operation::T Scalar::compute(Inputs input) const
 {
     return input.front() * m_scalar;
 }
@@ -19,4 +19,11 @@ void Scalar::print(std::ostream& ostr, bool first_print) const
 {
     (void)first_print; // Cast to void to avoid unused parameter warning
     ostr << "scal " << m_scalar;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+
+void Scalar::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
@@ -0,0 +1,146 @@
+#include "Server.h"
+#include "FunctionCalculator.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    const SocketHandle NO_SOCKET = INVALID_SOCKET;
+
+    // Winsock is started once for the process
+    void startSockets()
+    {
+        static const bool started = []
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if (!started)
+            throw std::runtime_error("Failed to start Winsock.");
+    }
+#else
+    const SocketHandle NO_SOCKET = -1;
+
+    void startSockets() {}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+Server::Server(std::string path, const CalculatorOptions& options)
+    : m_path(std::move(path)), m_options(options),
+      m_registry(std::make_shared<OperationRegistry>(
+          options.maxOperations != 0 ? options.maxOperations : MAX_OPERATION_LIMIT))
+{
+    // There is no console for a session to ask on
+    if (m_options.scriptPolicy == ScriptPolicy::Ask)
+        m_options.scriptPolicy = ScriptPolicy::Collect;
+}
+
+//-----------------------------------------------------------------------------
+
+Server::~Server()
+{
+    if (!m_listening)
+        return;
+
+    closeSocket(m_listener);
+    std::error_code error;
+    std::filesystem::remove(m_path, error);
+}
+
+//-----------------------------------------------------------------------------
+
+void Server::run()
+{
+    listen();
+    std::cout << "Serving sessions on " << m_path << std::endl;
+
+    while (true)
+    {
+        const SocketHandle client = ::accept(m_listener, nullptr, nullptr);
+        if (client == NO_SOCKET)
+        {
+#ifndef _WIN32
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+#endif
+            throw std::runtime_error("Failed to accept a connection on " + m_path + ".");
+        }
+        startSession(client);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// A socket left by an earlier server is replaced, but no other kind of file
+void Server::listen()
+{
+    startSockets();
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (m_path.empty() || m_path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Invalid socket path: '" + m_path + "'.");
+    std::memcpy(address.sun_path, m_path.c_str(), m_path.size() + 1);
+
+    std::error_code error;
+    const auto status = std::filesystem::symlink_status(m_path, error);
+    if (std::filesystem::exists(status))
+    {
+        if (!std::filesystem::is_socket(status))
+            throw std::runtime_error("The file " + m_path + " exists and is not a socket.");
+        std::filesystem::remove(m_path, error);
+    }
+
+    m_listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener == NO_SOCKET)
+        throw std::runtime_error("Failed to create a socket.");
+
+    if (::bind(m_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(m_listener, SOMAXCONN) != 0)
+    {
+        closeSocket(m_listener);
+        throw std::runtime_error("Failed to listen on " + m_path + ".");
+    }
+    m_listening = true;
+}
+
+//-----------------------------------------------------------------------------
+
+// The session owns copies of all it uses, so it may outlive the server
+void Server::startSession(SocketHandle client)
+{
+    std::cout << "Session #" << ++m_sessions << " connected" << std::endl;
+
+    std::thread([client, registry = m_registry, options = m_options]
+    {
+        SocketBuffer buffer(client);
+        std::iostream stream(&buffer);
+        try
+        {
+            FunctionCalculator(stream, stream, registry, options).run();
+        }
+        catch (const std::exception&)
+        {
+            // Only this session ends
+        }
+    }).detach();
+}
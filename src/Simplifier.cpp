@@ -0,0 +1,364 @@
+#include "Simplifier.h"
+#include "OperationVisitor.h"
+#include "Identity.h"
+#include "Transpose.h"
+#include "Scalar.h"
+#include "Add.h"
+#include "Sub.h"
+#include "Mul.h"
+#include "Comp.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Largest folded scalar: its product with an in-range int fits an int,
+    // and every element type holds it (an int16 is scaled in int, an int64
+    // holds 32-bit values)
+    const std::int64_t MAX_FOLDED_SCALAR =
+        std::min<std::int64_t>(std::numeric_limits<int>::max() / std::max(-MIN_ALLOWED_VALUE, MAX_ALLOWED_VALUE),
+                               std::numeric_limits<std::int16_t>::max());
+
+    int wrapMul(int a, int b) { return static_cast<int>(static_cast<unsigned>(a) * static_cast<unsigned>(b)); }
+
+    // 'operation' as base -> scal k, when it ends with a scalar
+    std::optional<std::pair<std::shared_ptr<Operation>, int>>
+    splitScalar(const std::shared_ptr<Operation>& operation)
+    {
+        if (const auto scalar = dynamic_cast<const Scalar*>(operation.get()))
+            return std::make_pair(makeOperation<Identity>(), scalar->scalar());
+
+        const auto comp = dynamic_cast<const Comp*>(operation.get());
+        if (!comp)
+            return std::nullopt;
+        const auto scalar = dynamic_cast<const Scalar*>(comp->second().get());
+        if (!scalar)
+            return std::nullopt;
+        return std::make_pair(comp->first(), scalar->scalar());
+    }
+
+    // The distinct nodes of the graph under 'root', each counted once
+    std::size_t nodeCount(const Operation& root)
+    {
+        std::unordered_set<const Operation*> visited{ &root };
+        std::vector<const Operation*> pending{ &root };
+        while (!pending.empty())
+        {
+            const auto* binary = dynamic_cast<const BinaryOperation*>(pending.back());
+            pending.pop_back();
+            if (!binary)
+                continue;
+
+            for (const Operation* operand : { binary->first().get(), binary->second().get() })
+            {
+                if (visited.insert(operand).second)
+                    pending.push_back(operand);
+            }
+        }
+        return visited.size();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+// The unary operations applied in turn to one matrix, kept as the scalars to
+// multiply it by (in order) and whether it ends up transposed. A transpose
+// only moves values around, so it commutes with the scalars and with their
+// range checks.
+// A chain holds equivalent scalars in place of those it folded, so the chain
+// of a comp is the chain of its first operand with that of its second one
+// appended (see Simplifier::chainOf).
+class Simplifier::Chain : public OperationVisitor
+{
+public:
+    explicit Chain(RangePolicy policy) : m_policy(policy) {}
+
+    // Appends a unary operation other than a comp
+    void append(const Operation& operation) { operation.accept(*this); }
+    // Appends what 'next' does after what this chain does
+    void append(const Chain& next);
+    // Returns the chain as scalars followed by a transpose, or an identity
+    std::shared_ptr<Operation> build() const;
+    // The number of nodes build() creates
+    std::size_t nodeCount() const;
+    bool empty() const { return m_scalars.empty() && !m_transposed; }
+
+    void visit(const Identity& operation) override;
+    void visit(const Transpose& operation) override;
+    void visit(const Scalar& operation) override;
+    // Comps are walked by Simplifier::chainOf, a chain has a single input
+    // so it has none of the others
+    void visit(const Comp& operation) override;
+    void visit(const Add& operation) override;
+    void visit(const Sub& operation) override;
+    void visit(const Mul& operation) override;
+
+private:
+    void scale(int scalar);
+
+    RangePolicy m_policy;
+    std::vector<int> m_scalars;
+    bool m_transposed = false;
+};
+
+//-----------------------------------------------------------------------------
+
+std::shared_ptr<Operation> Simplifier::Chain::build() const
+{
+    std::shared_ptr<Operation> chain;
+    const auto then = [&chain](std::shared_ptr<Operation> next)
+    {
+        chain = chain ? makeOperation<Comp>(chain, next) : std::move(next);
+    };
+
+    for (const int scalar : m_scalars)
+        then(makeOperation<Scalar>(scalar));
+    if (m_transposed)
+        then(makeOperation<Transpose>());
+
+    return chain ? chain : makeOperation<Identity>();
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t Simplifier::Chain::nodeCount() const
+{
+    // Every operation after the first one comes with a comp
+    const std::size_t operations = m_scalars.size() + (m_transposed ? 1 : 0);
+    return operations == 0 ? 1 : 2 * operations - 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::append(const Chain& next)
+{
+    for (const int scalar : next.m_scalars)
+        scale(scalar);
+    m_transposed = m_transposed != next.m_transposed;
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::scale(int scalar)
+{
+    // The matrix is in range (or wraps anyway), so 1*x changes nothing
+    if (scalar == 1)
+        return;
+    if (m_scalars.empty())
+    {
+        m_scalars.push_back(scalar);
+        return;
+    }
+
+    int& last = m_scalars.back();
+    if (m_policy == RangePolicy::Unchecked)
+    {
+        // Wrapping products are associative
+        last = wrapMul(last, scalar);
+        if (last == 1)
+            m_scalars.pop_back();
+        return;
+    }
+
+    // 0*x is in range and stays 0
+    if (last == 0)
+        return;
+
+    // With b >= 1, |a*b*x| >= |a*x| and has the same sign, so a*x out of
+    // range means a*b*x is out of range too
+    const std::int64_t product = std::int64_t{ last } * scalar;
+    if (scalar >= 1 && std::abs(product) <= MAX_FOLDED_SCALAR)
+        last = static_cast<int>(product);
+    else
+        m_scalars.push_back(scalar);
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Identity& operation)
+{
+    (void)operation;
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Transpose& operation)
+{
+    (void)operation;
+    m_transposed = !m_transposed;
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Scalar& operation)
+{
+    scale(operation.scalar());
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Comp& operation)
+{
+    (void)operation;
+    assert(false);
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Add& operation)
+{
+    (void)operation;
+    assert(false);
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Sub& operation)
+{
+    (void)operation;
+    assert(false);
+}
+
+//-----------------------------------------------------------------------------
+
+void Simplifier::Chain::visit(const Mul& operation)
+{
+    (void)operation;
+    assert(false);
+}
+
+//-----------------------------------------------------------------------------
+
+// Walks the distinct nodes of 'operation' (a unary operation or a comp of
+// them) once each, without recursion: a comp is combined from the chains of
+// its operands once both are known. Returns nullopt as soon as a chain would
+// build more than maxNodes nodes - chains do not get shorter as they grow.
+std::optional<Simplifier::Chain> Simplifier::chainOf(const Operation& operation, std::size_t maxNodes) const
+{
+    std::unordered_map<const Operation*, Chain> chains;
+    std::vector<const Operation*> pending{ &operation };
+
+    while (!pending.empty())
+    {
+        const Operation* node = pending.back();
+        if (chains.contains(node))
+        {
+            pending.pop_back();
+            continue;
+        }
+
+        Chain chain(m_policy);
+        if (const auto comp = dynamic_cast<const Comp*>(node))
+        {
+            const auto first = chains.find(comp->first().get());
+            const auto second = chains.find(comp->second().get());
+            if (first == chains.end() || second == chains.end())
+            {
+                if (first == chains.end())
+                    pending.push_back(comp->first().get());
+                if (second == chains.end())
+                    pending.push_back(comp->second().get());
+                continue;
+            }
+            chain = first->second;
+            chain.append(second->second);
+        }
+        else chain.append(*node);
+
+        pending.pop_back();
+        if (chain.nodeCount() > maxNodes)
+            return std::nullopt;
+        chains.emplace(node, std::move(chain));
+    }
+    return std::move(chains.at(&operation));
+}
+
+//-----------------------------------------------------------------------------
+
+// A rewrite that would take more nodes than the graph it replaces is not done
+std::shared_ptr<Operation> Simplifier::simplify(const std::shared_ptr<Operation>& operation) const
+{
+    // Only unary operations and their comps have a single input
+    if (operation->inputCount() == 1)
+    {
+        const auto chain = chainOf(*operation, nodeCount(*operation));
+        return chain ? chain->build() : operation;
+    }
+
+    if (dynamic_cast<const Comp*>(operation.get()))
+        return simplifyComp(operation);
+
+    if (m_policy == RangePolicy::Unchecked && !dynamic_cast<const Mul*>(operation.get()))
+        return factorScalar(operation);
+
+    return operation;
+}
+
+//-----------------------------------------------------------------------------
+
+std::shared_ptr<Operation> Simplifier::simplifyComp(const std::shared_ptr<Operation>& operation) const
+{
+    const auto& comp = static_cast<const Comp&>(*operation);
+
+    // iden -> g is g
+    if (comp.second()->inputCount() != 1)
+    {
+        if (dynamic_cast<const Identity*>(comp.first().get()))
+            return comp.second();
+        return operation;
+    }
+
+    // f -> u, where f may itself end with a chain: the chains are merged
+    const std::size_t nodes = nodeCount(*operation);
+    std::shared_ptr<Operation> head = comp.first();
+    Chain tail(m_policy);
+    const auto firstComp = dynamic_cast<const Comp*>(head.get());
+    if (firstComp && firstComp->second()->inputCount() == 1)
+    {
+        const auto before = chainOf(*firstComp->second(), nodes);
+        if (!before)
+            return operation;
+        tail = *before;
+        head = firstComp->first();
+    }
+    const auto after = chainOf(*comp.second(), nodes);
+    if (!after)
+        return operation;
+    tail.append(*after);
+
+    if (tail.empty())
+        return head;
+    if (nodeCount(*head) + tail.nodeCount() + 1 > nodes)
+        return operation;
+    return makeOperation<Comp>(head, tail.build());
+}
+
+//-----------------------------------------------------------------------------
+
+// Without range checks, (f -> scal k) + (g -> scal k) is (f + g) -> scal k
+std::shared_ptr<Operation> Simplifier::factorScalar(const std::shared_ptr<Operation>& operation) const
+{
+    const auto& binary = static_cast<const BinaryOperation&>(*operation);
+    const auto lhs = splitScalar(binary.first());
+    const auto rhs = splitScalar(binary.second());
+    if (!lhs || !rhs || lhs->second != rhs->second)
+        return operation;
+
+    std::shared_ptr<Operation> factored;
+    if (dynamic_cast<const Add*>(operation.get()))
+        factored = makeOperation<Add>(lhs->first, rhs->first);
+    else
+        factored = makeOperation<Sub>(lhs->first, rhs->first);
+
+    return simplify(makeOperation<Comp>(simplify(factored),
+                                           makeOperation<Scalar>(lhs->second)));
+}
@@ -0,0 +1,138 @@
+#include "SocketBuffer.h"
+
+#include <algorithm>
+#include <climits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#else
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // A send to a client that went away fails instead of raising SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    // Returns the number of bytes received, 0 at the end of the input, or
+    // a negative number on an error
+    long long receive(SocketHandle socket, char* data, std::size_t size)
+    {
+#ifdef _WIN32
+        return ::recv(socket, data, static_cast<int>(std::min<std::size_t>(size, INT_MAX)), 0);
+#else
+        while (true)
+        {
+            const ssize_t received = ::recv(socket, data, size, 0);
+            if (received >= 0 || errno != EINTR)
+                return received;
+        }
+#endif
+    }
+
+    long long send(SocketHandle socket, const char* data, std::size_t size)
+    {
+#ifdef _WIN32
+        return ::send(socket, data, static_cast<int>(std::min<std::size_t>(size, INT_MAX)), SEND_FLAGS);
+#else
+        while (true)
+        {
+            const ssize_t sent = ::send(socket, data, size, SEND_FLAGS);
+            if (sent >= 0 || errno != EINTR)
+                return sent;
+        }
+#endif
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void closeSocket(SocketHandle socket)
+{
+#ifdef _WIN32
+    ::closesocket(socket);
+#else
+    ::close(socket);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+
+SocketBuffer::SocketBuffer(SocketHandle socket)
+    : m_socket(socket), m_input(BUFFER_BYTES), m_output(BUFFER_BYTES)
+{
+    setg(m_input.data(), m_input.data(), m_input.data());
+    setp(m_output.data(), m_output.data() + m_output.size());
+}
+
+//-----------------------------------------------------------------------------
+
+SocketBuffer::~SocketBuffer()
+{
+    flush();
+    closeSocket(m_socket);
+}
+
+//-----------------------------------------------------------------------------
+
+SocketBuffer::int_type SocketBuffer::underflow()
+{
+    if (!flush())
+        return traits_type::eof();
+
+    const long long received = receive(m_socket, m_input.data(), m_input.size());
+    if (received <= 0)
+        return traits_type::eof();
+
+    setg(m_input.data(), m_input.data(), m_input.data() + received);
+    return traits_type::to_int_type(*gptr());
+}
+
+//-----------------------------------------------------------------------------
+
+SocketBuffer::int_type SocketBuffer::overflow(int_type c)
+{
+    if (!flush())
+        return traits_type::eof();
+
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+//-----------------------------------------------------------------------------
+
+int SocketBuffer::sync()
+{
+    return flush() ? 0 : -1;
+}
+
+//-----------------------------------------------------------------------------
+
+bool SocketBuffer::flush()
+{
+    const char* data = pbase();
+    std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+    setp(m_output.data(), m_output.data() + m_output.size());
+
+    while (size > 0)
+    {
+        const long long sent = send(m_socket, data, size);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
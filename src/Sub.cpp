@@ -3,13 +3,14 @@
 
 //-----------------------------------------------------------------------------
 
-Operation::T Sub::compute(const std::vector<T>& input) const
+Operation::T Sub::compute(Inputs input) const
 {
-    const auto a = first()->compute(input);
-    auto firstCount = first()->inputCount();
-	//remove the firstCount elements from the input vector, and put in a new vector
-	std::vector input2(input.begin() + firstCount, input.end());
-    const auto b = second()->compute(input2);
+    // The linear part of the tree (sums, differences, scalars and transposes)
+    // is computed in a single pass over the inputs - unless it is profiled
+    if (const FusedExpression* expression = Profiler::active() ? nullptr : fused())
+        return expression->evaluate(input);
+
+    const auto [a, b] = computeOperands(input);
 
     return a - b;
 }
@@ -19,4 +20,11 @@ Operation::T Sub::compute(const std::vector<T>& input) const
 void Sub::printSymbol(std::ostream& ostr) const
 {
     ostr << '-';
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+
+void Sub::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
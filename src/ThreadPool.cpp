@@ -0,0 +1,187 @@
+#include "ThreadPool.h"
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(std::size_t threads)
+{
+    threads = std::clamp<std::size_t>(threads, 1, MAX_THREAD_COUNT);
+    // threads - 1 workers and as many callers as there are threads
+    for (std::size_t i = 0; i < 2 * threads - 1; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    for (std::size_t i = 0; i + 1 < threads; ++i)
+        m_workers.emplace_back([this, i](std::stop_token stop) { work(i, stop); });
+}
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    for (auto& worker : m_workers)
+        worker.request_stop();
+    m_workers.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::configure(std::size_t threads)
+{
+    s_configuredThreads = threads != 0 ? threads
+                                       : std::max(1u, std::thread::hardware_concurrency());
+}
+
+//-----------------------------------------------------------------------------
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool(s_configuredThreads);
+    return pool;
+}
+
+//-----------------------------------------------------------------------------
+
+std::size_t ThreadPool::taskCount(std::size_t work) const
+{
+    // A few tasks per thread, so a thread that finishes early can steal
+    return std::clamp<std::size_t>(work / PARALLEL_MIN_WORK, 1, threadCount() * 4);
+}
+
+//-----------------------------------------------------------------------------
+
+// A queue is released empty: every job of a join is done when it returns
+ThreadPool::CallerScope::CallerScope(ThreadPool& pool) : m_pool(pool)
+{
+    if (t_pool == &pool)
+        return;
+
+    for (std::size_t i = pool.m_workers.size(); i < pool.m_queues.size(); ++i)
+    {
+        Queue& queue = *pool.m_queues[i];
+        if (queue.claimed.exchange(true, std::memory_order_acquire))
+            continue;
+
+        t_pool = &pool;
+        t_queue = i;
+        m_claimed = &queue;
+        return;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::CallerScope::~CallerScope()
+{
+    if (!m_claimed)
+        return;
+
+    t_pool = nullptr;
+    m_claimed->claimed.store(false, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::push(Job& job)
+{
+    {
+        Queue& queue = *m_queues[t_queue];
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.push_back(&job);
+    }
+    {
+        // Counted under the idle mutex, so a worker about to sleep sees it
+        std::lock_guard lock(m_idleMutex);
+        ++m_pending;
+    }
+    m_idle.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+
+bool ThreadPool::takeBack(Job& job)
+{
+    Queue& queue = *m_queues[t_queue];
+    std::lock_guard lock(queue.mutex);
+    if (queue.jobs.empty() || queue.jobs.back() != &job)
+        return false;
+
+    queue.jobs.pop_back();
+    --m_pending;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+ThreadPool::Job* ThreadPool::take()
+{
+    for (std::size_t i = 0; i < m_queues.size(); ++i)
+    {
+        const std::size_t index = (t_queue + i) % m_queues.size();
+        Queue& queue = *m_queues[index];
+        std::lock_guard lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+
+        Job* job;
+        if (index == t_queue)
+        {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        --m_pending;
+        return job;
+    }
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::execute(Job& job)
+{
+    try
+    {
+        job.run();
+    }
+    catch (...)
+    {
+        job.error = std::current_exception();
+    }
+    job.done.store(true, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::waitFor(Job& job)
+{
+    while (!job.done.load(std::memory_order_acquire))
+    {
+        if (Job* other = take())
+            execute(*other);
+        else
+            std::this_thread::yield();
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void ThreadPool::work(std::size_t queue, std::stop_token stop)
+{
+    t_pool = this;
+    t_queue = queue;
+
+    while (!stop.stop_requested())
+    {
+        if (Job* job = take())
+        {
+            execute(*job);
+            continue;
+        }
+
+        std::unique_lock lock(m_idleMutex);
+        m_idle.wait(lock, stop, [this] { return m_pending > 0; });
+    }
+}
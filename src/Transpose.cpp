@@ -1,9 +1,14 @@
 #include "Transpose.h"
+#include <utility>
 
 //-----------------------------------------------------------------------------
 
-Operation::T Transpose::compute(const std::vector<T>& input) const
+// An input nothing else reads (the result of a Comp's first operation) is
+// transposed in place instead of copied
+Operation::T Transpose::compute(Inputs input) const
 {
+    if (T* const owned = input.ownedFront())
+        return std::move(*owned).Transpose();
     return input.front().Transpose();
 }
 
@@ -13,4 +18,11 @@ void Transpose::print(std::ostream& ostr, bool first_print) const
 {
     (void)first_print; // Cast to void to avoid unused parameter warning
     ostr << "tran";
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+
+void Transpose::accept(OperationVisitor& visitor) const
+{
+    visitor.visit(*this);
+}
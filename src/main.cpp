@@ -1,8 +1,50 @@
 #include "FunctionCalculator.h"
+#include "CalculatorOptions.h"
+#include "SquareMatrix.h"
+#include "ElementTypes.h"
+#include "ThreadPool.h"
+#include "Server.h"
 #include <string>
 #include <iostream>
 
-int main()
+int main(int argc, char* argv[])
 {
-    FunctionCalculator(std::cin, std::cout).run();
+    // Before any output: std::cin gets a buffer of its own, which matrices
+    // are parsed from in place
+    std::ios::sync_with_stdio(false);
+
+    CalculatorOptions options;
+    try
+    {
+        options = CalculatorOptions::parse(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n' << CalculatorOptions::usage();
+        return 1;
+    }
+
+    forEachElementType([&]<typename T>()
+    {
+        SquareMatrix<T>::setRangePolicy(options.rangePolicy);
+        if (const auto& range = std::get<AllowedRange<T>>(options.allowedRanges))
+            SquareMatrix<T>::setAllowedRange(range->first, range->second);
+    });
+    ThreadPool::configure(options.threads);
+
+    if (!options.servePath.empty())
+    {
+        try
+        {
+            Server(options.servePath, options).run();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
+    FunctionCalculator(std::cin, std::cout, options).run();
 }